@@ -1,15 +1,103 @@
 #include "CompilerParser.h"
 #include <iostream>
+#include <vector>
+#include <exception>
 using namespace std;
 
+/**
+ * Parses a skimmed subroutine body the first time its children are needed
+ */
+class LazySubroutineBody : public ParseTreeLoader {
+    private:
+        std::vector<Token*> tokens;
+        HashConsTable* hashCons;
+
+    public:
+        LazySubroutineBody(std::vector<Token*> tokens, HashConsTable* hashCons) {
+            LazySubroutineBody::tokens = tokens;
+            LazySubroutineBody::hashCons = hashCons;
+        }
+
+        ParseTree* load() {
+            CompilerParser parser(std::list<Token*>(tokens.begin(), tokens.end()));
+            parser.setHashConsTable(hashCons);
+            return parser.compileSubroutineBody();
+        }
+};
+
+/**
+ * Destroys a node under construction if an exception unwinds past it, so a failed
+ * parse frees its partial tree instead of leaking it
+ */
+class PartialTree {
+    private:
+        ParseTree* tree;
+        int exceptions;
+
+    public:
+        PartialTree(ParseTree* tree) {
+            PartialTree::tree = tree;
+            PartialTree::exceptions = std::uncaught_exceptions();
+        }
+
+        ~PartialTree() {
+            if (std::uncaught_exceptions() > exceptions) {
+                ParseTree::destroy(tree);
+            }
+        }
+};
 
 /**
  * Constructor for the CompilerParser
  * @param tokens A linked list of tokens to be parsed
  */
 CompilerParser::CompilerParser(std::list<Token*> tokens) {
-    t1->tokens = tokens;  // 将传入的 tokens 赋值给类的成员变量 t1->tokens
-    t1->currentItr = t1->tokens.begin();  // 初始化当前迭代器指向 tokens 的起始位置
+    hashCons = NULL;  // 默认不共享子树
+    outline = false;  // 默认完整解析子程序体
+    reset(tokens);
+}
+
+/**
+ * Load a new token list so the same parser can be reused for another program
+ * @param tokens A linked list of tokens to be parsed
+ */
+void CompilerParser::reset(std::list<Token*> tokens) {
+    CompilerParser::tokens = tokens;  // 将传入的 tokens 赋值给成员变量
+    CompilerParser::currentItr = CompilerParser::tokens.begin();  // 初始化当前迭代器指向 tokens 的起始位置
+}
+
+/**
+ * Turn on hash-consing: identical declarations and statements are shared through the given table
+ * instead of being built again, so repeated code costs one subtree. Shared subtrees are owned by
+ * the table and must not be modified.
+ * @param table The table to share subtrees through, or NULL to build every subtree separately
+ */
+void CompilerParser::setHashConsTable(HashConsTable* table) {
+    hashCons = table;
+}
+
+/**
+ * Turn on outline mode: subroutine bodies are only brace-matched, and their statements are parsed
+ * the first time the body's children are needed. Outline builds only pay for class variables and
+ * subroutine signatures; a syntax error inside a body is reported when that body is first used.
+ * The tokens must outlive the tree, and so must the HashConsTable if one is set, since bodies
+ * that have not been loaded yet intern their statements through it when they are.
+ * @param outline true to skim subroutine bodies, false to parse them right away
+ */
+void CompilerParser::setOutlineMode(bool outline) {
+    CompilerParser::outline = outline;
+}
+
+/**
+ * Replace a finished subtree with its shared copy when hash-consing is on
+ * @param tree The subtree that was just built
+ * @return The subtree to add to the parent
+ */
+ParseTree* CompilerParser::share(ParseTree* tree) {
+    if (hashCons == NULL) {
+        return tree;
+    }
+    return hashCons->intern(tree);
 }
 
 /**
@@ -33,6 +121,24 @@ ParseTree* CompilerParser::compileProgram() {
     return nullptr;  // 返回空指针
 }
 
+/**
+ * Generates a parse tree for a single program, collecting memory statistics along the way
+ * @param stats Filled with the token count and the nodes and bytes allocated by this parse
+ * @return a ParseTree
+ */
+ParseTree* CompilerParser::compileProgram(ParseStats* stats) {
+    stats->tokens = tokens.size();
+    stats->activate();  // 统计本次解析中所有节点、字符串和子节点列表的分配
+    try {
+        ParseTree* ER1 = compileProgram();
+        stats->deactivate();
+        return ER1;
+    } catch (...) {
+        stats->deactivate();  // 任何异常（包括 bad_alloc）都要停止统计
+        throw;
+    }
+}
+
 /**
  * Generates a parse tree for a single class
  * @return a ParseTree
@@ -40,6 +146,7 @@ ParseTree* CompilerParser::compileProgram() {
 ParseTree* CompilerParser::compileClass() {
     
     ParseTree* ER1 = new ParseTree("class", "");
+    PartialTree guard(ER1);  // 解析失败时释放未完成的子树
     ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加当前标记作为子节点
     next();
     ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加类名标记
@@ -61,7 +168,7 @@ ParseTree* CompilerParser::compileClass() {
         } 
         // 如果当前是静态变量或字段声明，则调用 compileClassVarDec 方法解析
         else if (have("keyword", "static") || have("keyword", "field")) {
-            ER1->addChild(compileClassVarDec());
+            ER1->addChild(share(compileClassVarDec()));
         } 
         // 否则抛出异常
         else {
@@ -88,6 +195,7 @@ ParseTree* CompilerParser::compileClass() {
 ParseTree* CompilerParser::compileClassVarDec() {
     // 创建一个新的解析树节点，表示类变量声明
     ParseTree* ER1 = new ParseTree("classVarDec", "");
+    PartialTree guard(ER1);  // 解析失败时释放未完成的子树
     ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加变量声明类型为子节点
 
     next();
@@ -137,6 +245,7 @@ ParseTree* CompilerParser::compileClassVarDec() {
 ParseTree* CompilerParser::compileSubroutine() {
     
     ParseTree* ER1 = new ParseTree("subroutine", "");  // 创建子程序解析树节点
+    PartialTree guard(ER1);  // 解析失败时释放未完成的子树
     ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加子程序类型（例如函数或方法）
     next();
 
@@ -178,7 +287,11 @@ ParseTree* CompilerParser::compileSubroutine() {
         throw ParseException();
         return NULL;
     }
-    ER1->addChild(compileSubroutineBody());  // 解析子程序体
+    if (outline) {
+        ER1->addChild(skimSubroutineBody());  // 只记录子程序体的 token 范围，稍后再解析
+    } else {
+        ER1->addChild(compileSubroutineBody());  // 解析子程序体
+    }
 
     return ER1;
 }
@@ -189,6 +302,7 @@ ParseTree* CompilerParser::compileSubroutine() {
  */
 ParseTree* CompilerParser::compileParameterList() {
     ParseTree* ER1 = new ParseTree("parameterList", "");  // 创建参数列表解析树节点
+    PartialTree guard(ER1);  // 解析失败时释放未完成的子树
 
     // 检查参数类型是否合法
     if (!have("keyword", "int") && !have("keyword", "char") && !have("keyword", "boolean") && current()->getType() != "identifier") {
@@ -250,16 +364,21 @@ ParseTree* CompilerParser::compileParameterList() {
  */
 ParseTree* CompilerParser::compileSubroutineBody() {
     ParseTree* ER1 = new ParseTree("subroutineBody", "");  // 创建子程序体解析树节点
+    PartialTree guard(ER1);  // 解析失败时释放未完成的子树
     ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加 "{" 符号
     next();
     
     // 解析子程序体中的变量声明和语句
     while (currentItr != tokens.end() && !have("symbol", "}")) {
         if (have("keyword", "var")) {  // 解析局部变量声明
-            ER1->addChild(compileVarDec());
+            ER1->addChild(share(compileVarDec()));
             next();
             continue;
         }
+        // 既不是 var 也不是语句，compileStatements 不会前进，必须报错以免死循环
+        if (!have("keyword", "let") && !have("keyword", "if") && !have("keyword", "while") && !have("keyword", "do") && !have("keyword", "return")) {
+            throw ParseException();
+        }
         ER1->addChild(compileStatements());  // 解析子程序体中的语句
     }
     
@@ -271,12 +390,45 @@ ParseTree* CompilerParser::compileSubroutineBody() {
     return ER1;
 }
 
+/**
+ * Generates a deferred parse tree for a subroutine's body. The body's tokens are brace-matched
+ * and saved, and its hash covers those tokens.
+ * @return a ParseTree whose children are parsed on first access
+ */
+ParseTree* CompilerParser::skimSubroutineBody() {
+    ParseTree* ER1 = new ParseTree("subroutineBody", "");  // 创建子程序体解析树节点
+    PartialTree guard(ER1);  // 解析失败时释放未完成的子树
+    size_t hash = ER1->getHash();
+    vector<Token*> body;
+    int depth = 0;
+
+    // 从 "{" 开始匹配括号，直到对应的 "}"
+    while (true) {
+        Token* token = current();  // 到达输入末尾时抛出异常
+        body.push_back(token);
+        hash = ParseTree::combineHash(hash, token->getHash());
+        if (token->getType() == "symbol") {
+            string value = token->getValue();
+            if (value == "{") {
+                depth++;
+            } else if (value == "}" && --depth == 0) {
+                break;  // 停在 "}" 上，与 compileSubroutineBody 一致
+            }
+        }
+        next();
+    }
+
+    ER1->defer(new LazySubroutineBody(body, hashCons), hash);
+    return ER1;
+}
+
 /**
  * Generates a parse tree for a subroutine variable declaration
  * @return a ParseTree
  */
 ParseTree* CompilerParser::compileVarDec() {
     ParseTree* ER1 = new ParseTree("varDec", "");  // 创建局部变量声明解析树节点
+    PartialTree guard(ER1);  // 解析失败时释放未完成的子树
     ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加 "var" 关键字
     
     next();
@@ -325,6 +477,7 @@ ParseTree* CompilerParser::compileVarDec() {
  */
 ParseTree* CompilerParser::compileStatements() {
     ParseTree* ER1 = new ParseTree("statements", "");  // 创建语句解析树节点
+    PartialTree guard(ER1);  // 解析失败时释放未完成的子树
     
     // 循环解析各类语句（let、if、while、do、return）
     while (have("keyword", "let") || have("keyword", "if") || have("keyword", "while") || have("keyword", "do") || have("keyword", "return")) {
@@ -346,7 +499,7 @@ ParseTree* CompilerParser::compileStatements() {
             next();  // 移动到下一个 token
         }
     }
-    return ER1;
+    return share(ER1);  // 开启 hash-consing 时返回共享的子树
 }
 
 /**
@@ -355,6 +508,7 @@ ParseTree* CompilerParser::compileStatements() {
  */
 ParseTree* CompilerParser::compileLet() {
     ParseTree* ER1 = new ParseTree("letStatement", "");  // 创建 let 语句解析树节点
+    PartialTree guard(ER1);  // 解析失败时释放未完成的子树
     if (!have("keyword", "let")) {
         throw ParseException();
     }
@@ -370,7 +524,7 @@ ParseTree* CompilerParser::compileLet() {
     if (have("symbol", "[")) {  // 如果存在数组索引，解析数组表达式
         ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加 "[" 符号
         next();
-        ER1->addChild(compileExpER1sion());  // 解析表达式
+        ER1->addChild(compileExpRE1sion());  // 解析表达式
         
         if (!have("symbol", "]")) {  // 检查 "]" 符号
             throw ParseException();
@@ -385,7 +539,7 @@ ParseTree* CompilerParser::compileLet() {
     ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加 "=" 符号
     next();
 
-    ER1->addChild(compileExpER1sion());  // 解析赋值表达式
+    ER1->addChild(compileExpRE1sion());  // 解析赋值表达式
 
     if (!have("symbol", ";")) {  // 检查分号
         throw ParseException();
@@ -401,6 +555,7 @@ ParseTree* CompilerParser::compileLet() {
  */
 ParseTree* CompilerParser::compileIf() {
     ParseTree* ER1 = new ParseTree("ifStatement", "");  // 创建 if 语句解析树节点
+    PartialTree guard(ER1);  // 解析失败时释放未完成的子树
 
     if (!have("keyword", "if")) {
         throw ParseException();
@@ -414,7 +569,7 @@ ParseTree* CompilerParser::compileIf() {
     ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加 "(" 符号
     next();
 
-    ER1->addChild(compileExpER1sion());  // 解析 if 条件表达式
+    ER1->addChild(compileExpRE1sion());  // 解析 if 条件表达式
 
     if (!have("symbol", ")")) {
         throw ParseException();
@@ -437,6 +592,7 @@ ParseTree* CompilerParser::compileIf() {
     next();
 
     if (!have("keyword", "else")) {
+        prev();  // 没有 else，回到 "}"，与其他语句一样停在最后一个 token 上
         return ER1;
     }
     ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加 else 关键字
@@ -464,6 +620,7 @@ ParseTree* CompilerParser::compileIf() {
  */
 ParseTree* CompilerParser::compileWhile() {
     ParseTree* ER1 = new ParseTree("whileStatement", "");  // 创建 while 语句解析树节点
+    PartialTree guard(ER1);  // 解析失败时释放未完成的子树
     if (!have("keyword", "while")) {
         throw ParseException();
     }
@@ -476,7 +633,7 @@ ParseTree* CompilerParser::compileWhile() {
     ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加 "(" 符号
     next();
 
-    ER1->addChild(compileExpER1sion());  // 解析 while 条件表达式
+    ER1->addChild(compileExpRE1sion());  // 解析 while 条件表达式
 
     if (!have("symbol", ")")) {
         throw ParseException();
@@ -505,7 +662,8 @@ ParseTree* CompilerParser::compileWhile() {
  * @return a ParseTree
  */
 ParseTree* CompilerParser::compileDo() {
-    vParseTree* ER1 = new ParseTree("doStatement", "");  // 创建 do 语句解析树节点
+    ParseTree* ER1 = new ParseTree("doStatement", "");  // 创建 do 语句解析树节点
+    PartialTree guard(ER1);  // 解析失败时释放未完成的子树
 
     if (!have("keyword", "do")) {
         throw ParseException();
@@ -513,7 +671,7 @@ ParseTree* CompilerParser::compileDo() {
     ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加 do 关键字
     next();
 
-    ER1->addChild(compileExpER1sion());  // 解析表达式
+    ER1->addChild(compileExpRE1sion());  // 解析表达式
     
     if (!have("symbol", ";")) {  // 检查是否有分号
         throw ParseException();
@@ -529,6 +687,7 @@ ParseTree* CompilerParser::compileDo() {
  */
 ParseTree* CompilerParser::compileReturn() {
    ParseTree* ER1 = new ParseTree("returnStatement", "");  // 创建 return 语句解析树节点
+    PartialTree guard(ER1);  // 解析失败时释放未完成的子树
 
     if (!have("keyword", "return")) {
         throw ParseException();
@@ -541,7 +700,7 @@ ParseTree* CompilerParser::compileReturn() {
         return ER1;
     }
 
-    ER1->addChild(compileExpER1sion());  // 解析返回值表达式
+    ER1->addChild(compileExpRE1sion());  // 解析返回值表达式
     
     if (!have("symbol", ";")) {  // 检查分号
         throw ParseException();
@@ -557,7 +716,18 @@ ParseTree* CompilerParser::compileReturn() {
  * @return a ParseTree
  */
 ParseTree* CompilerParser::compileExpRE1sion() {
-    return NULL;
+    ParseTree* ER1 = new ParseTree("expression", "");  // 创建表达式解析树节点
+    PartialTree guard(ER1);  // 解析失败时释放未完成的子树
+    ER1->addChild(compileTerm());  // 解析第一个 term
+
+    // 处理 (op term)*
+    while (have("symbol", "+") || have("symbol", "-") || have("symbol", "*") || have("symbol", "/")
+            || have("symbol", "&") || have("symbol", "|") || have("symbol", "<") || have("symbol", ">") || have("symbol", "=")) {
+        ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加运算符
+        next();
+        ER1->addChild(compileTerm());
+    }
+    return ER1;
 }
 
 /**
@@ -565,7 +735,69 @@ ParseTree* CompilerParser::compileExpRE1sion() {
  * @return a ParseTree
  */
 ParseTree* CompilerParser::compileTerm() {
-    return NULL;
+    ParseTree* ER1 = new ParseTree("term", "");  // 创建 term 解析树节点
+    PartialTree guard(ER1);  // 解析失败时释放未完成的子树
+
+    // 常量
+    if (current()->getType() == "integerConstant" || current()->getType() == "stringConstant"
+            || have("keyword", "true") || have("keyword", "false") || have("keyword", "null") || have("keyword", "this")) {
+        ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));
+        next();
+        return ER1;
+    }
+
+    // 括号表达式
+    if (have("symbol", "(")) {
+        ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加 "(" 符号
+        next();
+        ER1->addChild(compileExpRE1sion());
+        ER1->addChild(new ParseTree("symbol", mustBe("symbol", ")")->getValue()));  // 添加 ")" 符号
+        return ER1;
+    }
+
+    // 一元运算符
+    if (have("symbol", "-") || have("symbol", "~")) {
+        ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));
+        next();
+        ER1->addChild(compileTerm());
+        return ER1;
+    }
+
+    // 变量名、数组元素或子程序调用
+    if (current()->getType() != "identifier") {
+        throw ParseException();
+    }
+    ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加标识符
+    next();
+
+    if (have("symbol", "[")) {  // 数组元素 name[expression]
+        ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加 "[" 符号
+        next();
+        ER1->addChild(compileExpRE1sion());
+        ER1->addChild(new ParseTree("symbol", mustBe("symbol", "]")->getValue()));  // 添加 "]" 符号
+        return ER1;
+    }
+
+    if (have("symbol", ".")) {  // 调用 name.name(expressionList)
+        ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加 "." 符号
+        next();
+        if (current()->getType() != "identifier") {
+            throw ParseException();
+        }
+        ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加子程序名
+        next();
+        if (!have("symbol", "(")) {
+            throw ParseException();
+        }
+    }
+
+    if (have("symbol", "(")) {  // 调用 name(expressionList)
+        ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加 "(" 符号
+        next();
+        ER1->addChild(compileExpRE1sionList());
+        ER1->addChild(new ParseTree("symbol", mustBe("symbol", ")")->getValue()));  // 添加 ")" 符号
+    }
+    return ER1;
 }
 
 /**
@@ -573,22 +805,49 @@ ParseTree* CompilerParser::compileTerm() {
  * @return a ParseTree
  */
 ParseTree* CompilerParser::compileExpRE1sionList() {
-    return NULL;
+    ParseTree* ER1 = new ParseTree("expressionList", "");  // 创建表达式列表解析树节点
+    PartialTree guard(ER1);  // 解析失败时释放未完成的子树
+    if (have("symbol", ")")) {  // 空列表
+        return ER1;
+    }
+
+    ER1->addChild(compileExpRE1sion());
+    while (have("symbol", ",")) {
+        ER1->addChild(new ParseTree(current()->getType(), current()->getValue()));  // 添加 "," 符号
+        next();
+        ER1->addChild(compileExpRE1sion());
+    }
+    return ER1;
 }
 
 /**
  * Advance to the next token
  */
 void CompilerParser::next(){
-    return;
+    if (currentItr != tokens.end()) {
+        currentItr++;
+    }
+}
+
+/**
+ * Go back to the previous token
+ */
+void CompilerParser::prev(){
+    if (currentItr != tokens.begin()) {
+        currentItr--;
+    }
 }
 
 /**
  * Return the current token
+ * Throws a ParseException at the end of the input instead of returning NULL.
  * @return the Token
  */
 Token* CompilerParser::current(){
-    return NULL;
+    if (currentItr == tokens.end()) {
+        throw ParseException();
+    }
+    return *currentItr;
 }
 
 /**
@@ -596,7 +855,10 @@ Token* CompilerParser::current(){
  * @return true if a match, false otherwise
  */
 bool CompilerParser::have(std::string expectedType, std::string expectedValue){
-    return false;
+    if (currentItr == tokens.end()) {
+        return false;
+    }
+    return (*currentItr)->getType() == expectedType && (*currentItr)->getValue() == expectedValue;
 }
 
 /**
@@ -605,7 +867,12 @@ bool CompilerParser::have(std::string expectedType, std::string expectedValue){
  * @return the current token before advancing
  */
 Token* CompilerParser::mustBe(std::string expectedType, std::string expectedValue){
-    return NULL;
+    if (!have(expectedType, expectedValue)) {
+        throw ParseException();
+    }
+    Token* token = current();
+    next();
+    return token;
 }
 
 /**
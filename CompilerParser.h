@@ -6,12 +6,30 @@
 
 #include "ParseTree.h"
 #include "Token.h"
+#include "HashConsTable.h"
+#include "ParseStats.h"
 
 class CompilerParser {
+    private:
+        std::list<Token*> tokens;
+        std::list<Token*>::iterator currentItr;
+        HashConsTable* hashCons;
+        bool outline;
+
+        ParseTree* share(ParseTree* tree);
+        ParseTree* skimSubroutineBody();
+
     public:
         CompilerParser(std::list<Token*> tokens);
 
+        void reset(std::list<Token*> tokens);
+
+        void setHashConsTable(HashConsTable* table);
+
+        void setOutlineMode(bool outline);
+
         ParseTree* compileProgram();
+        ParseTree* compileProgram(ParseStats* stats);
         ParseTree* compileClass();
         ParseTree* compileClassVarDec();
         ParseTree* compileSubroutine();
@@ -31,6 +49,7 @@ class CompilerParser {
         ParseTree* compileExpRE1sionList();
         
         void next();
+        void prev();
         Token* current();
         bool have(std::string expectedType, std::string expectedValue);
         Token* mustBe(std::string expectedType, std::string expectedValue);
@@ -0,0 +1,554 @@
+/*
+ * In-process fuzz target for CompilerParser.
+ *
+ * Each input is turned into a token list, either by mapping every byte onto a token from a
+ * fixed vocabulary, or by using the bytes to drive a generator for well-formed classes and
+ * then mutating the result. Every token list is parsed several ways and the results must agree:
+ *   - plain parse vs. parse with a HashConsTable (same text, empty TreeDiff)
+ *   - parses hash-consed by two different tables must still be equal
+ *   - plain parse vs. serialize() followed by deserialize()
+ *   - plain parse vs. outline parse with every subroutine body loaded on demand (same text,
+ *     equals() and an empty TreeDiff), also when the outline trees are interned in a HashConsTable
+ *   - ParseTreeIndex queries vs. a brute-force walk, on the plain and the hash-consed tree
+ * Before fuzzing, TreeDiff is checked against a few hand-written edits with known answers.
+ * These parses run on the heap and are freed with ParseTree::destroy, so LeakSanitizer (or
+ * libFuzzer's leak check) catches nodes the parser loses, e.g. on a ParseException. One more
+ * plain parse runs in a NodePool, the way the server parses, and must build the same tree.
+ *
+ * Standalone driver with sanitizers (reports execs/sec, aborts on a mismatch or a hang):
+ *   g++ -std=c++17 -g -O1 -fsanitize=address,undefined FuzzParser.cpp CompilerParser.cpp ParseTree.cpp \
+ *       Token.cpp NodePool.cpp HashConsTable.cpp TreeDiff.cpp ParseTreeIndex.cpp ParseStats.cpp -o FuzzParser
+ *   ./FuzzParser [seconds] [seed]
+ *
+ * libFuzzer:
+ *   clang++ -std=c++17 -g -O1 -DFUZZ_WITH_LIBFUZZER -fsanitize=fuzzer,address,undefined FuzzParser.cpp ... -o FuzzParser
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <list>
+#include <random>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cctype>
+#include <sstream>
+#include <csignal>
+#include <unistd.h>
+
+#include "CompilerParser.h"
+#include "HashConsTable.h"
+#include "NodePool.h"
+#include "TreeDiff.h"
+#include "ParseTreeIndex.h"
+
+using namespace std;
+
+/**
+ * Tokens the random decoder picks from
+ */
+static const char* VOCABULARY[][2] = {
+    {"keyword", "class"}, {"keyword", "constructor"}, {"keyword", "function"}, {"keyword", "method"},
+    {"keyword", "field"}, {"keyword", "static"}, {"keyword", "var"}, {"keyword", "int"},
+    {"keyword", "char"}, {"keyword", "boolean"}, {"keyword", "void"}, {"keyword", "true"},
+    {"keyword", "false"}, {"keyword", "null"}, {"keyword", "this"}, {"keyword", "let"},
+    {"keyword", "do"}, {"keyword", "if"}, {"keyword", "else"}, {"keyword", "while"},
+    {"keyword", "return"}, {"symbol", "{"}, {"symbol", "}"}, {"symbol", "("},
+    {"symbol", ")"}, {"symbol", "["}, {"symbol", "]"}, {"symbol", "."},
+    {"symbol", ","}, {"symbol", ";"}, {"symbol", "+"}, {"symbol", "-"},
+    {"symbol", "*"}, {"symbol", "/"}, {"symbol", "&"}, {"symbol", "|"},
+    {"symbol", "<"}, {"symbol", ">"}, {"symbol", "="}, {"symbol", "~"},
+    {"identifier", "Main"}, {"identifier", "a"}, {"identifier", "b"}, {"identifier", "f"},
+    {"integerConstant", "0"}, {"integerConstant", "7"}, {"stringConstant", "s"}, {"stringConstant", "two words"},
+};
+static const size_t VOCABULARY_SIZE = sizeof(VOCABULARY) / sizeof(VOCABULARY[0]);
+
+/**
+ * Reads entropy from the fuzz input, returning zeros once it runs out, so generator
+ * loops only continue on a non-zero pick
+ */
+class ByteReader {
+    private:
+        const uint8_t* data;
+        size_t size;
+        size_t offset;
+
+    public:
+        ByteReader(const uint8_t* data, size_t size) : data(data), size(size), offset(0) {}
+
+        unsigned pick(unsigned n) {
+            unsigned byte = offset < size ? data[offset++] : 0;
+            return n == 0 ? 0 : byte % n;
+        }
+
+        bool done() {
+            return offset >= size;
+        }
+};
+
+/**
+ * Builds well-formed Jack token lists from fuzz input
+ */
+class Generator {
+    private:
+        ByteReader& in;
+        TokenTable& table;
+        list<Token*> tokens;
+
+        void add(string type, string value) {
+            tokens.push_back(table.intern(type, value));
+        }
+
+        void identifier() {
+            static const char* names[] = {"a", "b", "f", "Main", "Output"};
+            add("identifier", names[in.pick(5)]);
+        }
+
+        void type() {
+            static const char* types[] = {"int", "char", "boolean"};
+            unsigned choice = in.pick(4);
+            if (choice < 3) {
+                add("keyword", types[choice]);
+            } else {
+                identifier();
+            }
+        }
+
+        void term(int depth) {
+            unsigned choice = depth > 3 ? in.pick(3) : in.pick(8);
+            switch (choice) {
+                case 0: add("integerConstant", to_string(in.pick(100))); break;
+                case 1: add("keyword", in.pick(2) ? "true" : "this"); break;
+                case 2: identifier(); break;
+                case 3: add("stringConstant", "str"); break;
+                case 4: add("symbol", "("); expression(depth + 1); add("symbol", ")"); break;
+                case 5: add("symbol", in.pick(2) ? "-" : "~"); term(depth + 1); break;
+                case 6: identifier(); add("symbol", "["); expression(depth + 1); add("symbol", "]"); break;
+                default: call(depth + 1); break;
+            }
+        }
+
+        void expression(int depth) {
+            static const char* ops[] = {"+", "-", "*", "/", "&", "|", "<", ">", "="};
+            term(depth);
+            while (depth < 4 && in.pick(3) == 1) {
+                add("symbol", ops[in.pick(9)]);
+                term(depth);
+            }
+        }
+
+        void call(int depth) {
+            identifier();
+            if (in.pick(2)) {
+                add("symbol", ".");
+                identifier();
+            }
+            add("symbol", "(");
+            if (in.pick(2)) {
+                expression(depth);
+                while (in.pick(3) == 1) {
+                    add("symbol", ",");
+                    expression(depth);
+                }
+            }
+            add("symbol", ")");
+        }
+
+        void statements(int depth) {
+            int count = depth > 2 ? in.pick(2) : in.pick(4);
+            for (int i = 0; i < count; i++) {
+                switch (in.pick(5)) {
+                    case 0:
+                        add("keyword", "let"); identifier();
+                        if (in.pick(3) == 0) {
+                            add("symbol", "["); expression(0); add("symbol", "]");
+                        }
+                        add("symbol", "="); expression(0); add("symbol", ";");
+                        break;
+                    case 1:
+                        add("keyword", "if"); add("symbol", "("); expression(0); add("symbol", ")");
+                        add("symbol", "{"); statements(depth + 1); add("symbol", "}");
+                        if (in.pick(2)) {
+                            add("keyword", "else"); add("symbol", "{"); statements(depth + 1); add("symbol", "}");
+                        }
+                        break;
+                    case 2:
+                        add("keyword", "while"); add("symbol", "("); expression(0); add("symbol", ")");
+                        add("symbol", "{"); statements(depth + 1); add("symbol", "}");
+                        break;
+                    case 3:
+                        add("keyword", "do"); call(0); add("symbol", ";");
+                        break;
+                    default:
+                        add("keyword", "return");
+                        if (in.pick(2)) {
+                            expression(0);
+                        }
+                        add("symbol", ";");
+                        break;
+                }
+            }
+        }
+
+        void varList(string keyword) {
+            add("keyword", keyword);
+            type();
+            identifier();
+            while (in.pick(3) == 1) {
+                add("symbol", ",");
+                identifier();
+            }
+            add("symbol", ";");
+        }
+
+        void subroutine() {
+            static const char* kinds[] = {"constructor", "function", "method"};
+            add("keyword", kinds[in.pick(3)]);
+            if (in.pick(3) == 0) {
+                add("keyword", "void");
+            } else {
+                type();
+            }
+            identifier();
+            add("symbol", "(");
+            if (in.pick(2)) {
+                type();
+                identifier();
+                while (in.pick(3) == 1) {
+                    add("symbol", ",");
+                    type();
+                    identifier();
+                }
+            }
+            add("symbol", ")");
+            add("symbol", "{");
+            for (int i = in.pick(3); i > 0; i--) {
+                varList("var");
+            }
+            statements(0);
+            add("symbol", "}");
+        }
+
+    public:
+        Generator(ByteReader& in, TokenTable& table) : in(in), table(table) {}
+
+        list<Token*> generate() {
+            add("keyword", "class");
+            identifier();
+            add("symbol", "{");
+            for (int i = in.pick(3); i > 0; i--) {
+                varList(in.pick(2) ? "field" : "static");
+            }
+            for (int i = in.pick(4); i > 0; i--) {
+                subroutine();
+            }
+            add("symbol", "}");
+            return tokens;
+        }
+};
+
+/**
+ * Apply a few random edits to a token list so the parser's error paths get exercised
+ */
+static void mutate(list<Token*>& tokens, ByteReader& in, TokenTable& table) {
+    for (int count = in.pick(4); count > 0 && !tokens.empty(); count--) {
+        auto it = tokens.begin();
+        advance(it, in.pick(tokens.size()));
+        switch (in.pick(3)) {
+            case 0: tokens.erase(it); break;
+            case 1: tokens.insert(it, *it); break;
+            default: {
+                const char** token = VOCABULARY[in.pick(VOCABULARY_SIZE)];
+                *it = table.intern(token[0], token[1]);
+                break;
+            }
+        }
+    }
+}
+
+static TokenTable vocabularyTable;
+static NodePool pool;
+static list<Token*> currentInput;
+
+/**
+ * Print the token list being parsed and abort, so the sanitizer or fuzzer records the input
+ */
+static void fail(string reason) {
+    cerr << "FuzzParser: " << reason << "\n";
+    for (Token* token : currentInput) {
+        cerr << token->getType() << " " << token->getValue() << "\n";
+    }
+    abort();
+}
+
+static void onTimeout(int) {
+    fail("hang: one input ran for more than 2s");
+}
+
+/**
+ * Parse a token list, returning the tree, or NULL on a ParseException
+ */
+static ParseTree* parse(list<Token*> tokens, HashConsTable* table, bool outline) {
+    CompilerParser parser(tokens);
+    parser.setHashConsTable(table);
+    parser.setOutlineMode(outline);
+    try {
+        return parser.compileProgram();
+    } catch (ParseException& e) {
+        return NULL;
+    }
+}
+
+/**
+ * Turn space-separated Jack source into tokens, for the fixed inputs of the known-answer checks
+ */
+static list<Token*> lex(string source) {
+    static const string KEYWORDS = " class constructor function method field static var int char boolean void "
+                                   "true false null this let do if else while return ";
+    list<Token*> tokens;
+    istringstream words(source);
+    string word;
+    while (words >> word) {
+        string type = "identifier";
+        if (KEYWORDS.find(" " + word + " ") != string::npos) {
+            type = "keyword";
+        } else if (word.size() == 1 && string("{}()[].,;+-*/&|<>=~").find(word) != string::npos) {
+            type = "symbol";
+        } else if (isdigit(word[0])) {
+            type = "integerConstant";
+        }
+        tokens.push_back(vocabularyTable.intern(type, word));
+    }
+    return tokens;
+}
+
+/**
+ * Check TreeDiff against hand-written edits before fuzzing, since random inputs
+ * almost never differ by exactly one statement or subroutine
+ */
+static void checkTreeDiff() {
+    string f = "function void f ( ) { let a = 1 ; return ; } ";
+    string g = "function void g ( ) { return ; } ";
+    string cases[][3] = {
+        {"class Main { " + f + "}", "class Main { function void f ( ) { let a = 2 ; return ; } }",
+         "~ class/subroutine:f[3]/subroutineBody[5]/statements[1]/letStatement[0]\n"},
+        {"class Main { " + f + "}", "class Main { " + f + g + "}", "+ class/subroutine:g[4]\n"},
+        {"class Main { " + f + g + "}", "class Main { " + f + "}", "- class/subroutine:g[4]\n"},
+        {"class Main { " + f + g + "}", "class Main { " + g + f + "}", "- class/subroutine:f[3]\n+ class/subroutine:f[4]\n"},
+    };
+    for (auto& diffCase : cases) {
+        currentInput = lex(diffCase[0]);
+        ParseTree* before = parse(currentInput, NULL, false);
+        currentInput = lex(diffCase[1]);
+        ParseTree* after = parse(currentInput, NULL, false);
+        string edits = TreeDiff::tostring(TreeDiff::diff(before, after));
+        if (edits != diffCase[2]) {
+            fail("TreeDiff gave\n" + edits + "instead of\n" + diffCase[2]);
+        }
+        ParseTree::destroy(before);
+        ParseTree::destroy(after);
+    }
+}
+
+/**
+ * Walk a tree in pre-order, recording every node and the parent of its first appearance
+ */
+static void walk(ParseTree* node, ParseTree* parent, vector<ParseTree*>& order, unordered_map<ParseTree*, ParseTree*>& parents) {
+    order.push_back(node);
+    if (node == NULL) {
+        return;
+    }
+    parents.emplace(node, parent);
+    for (ParseTree* child : node->getChildren()) {
+        walk(child, node, order, parents);
+    }
+}
+
+/**
+ * Check ParseTreeIndex against a brute-force walk: getParent for every node, and find by type
+ * and by leaf value over the whole tree and under every subroutine
+ */
+static void checkIndex(ParseTree* root) {
+    ParseTreeIndex index(root);
+    vector<ParseTree*> order;
+    unordered_map<ParseTree*, ParseTree*> parents;
+    walk(root, NULL, order, parents);
+    if (index.size() != order.size()) {
+        fail("ParseTreeIndex numbered a different number of nodes than a walk");
+    }
+    for (auto& entry : parents) {
+        if (index.getParent(entry.first) != entry.second) {
+            fail("ParseTreeIndex::getParent disagrees with a walk");
+        }
+    }
+
+    vector<ParseTree*> scopes = {NULL};
+    for (ParseTree* node : order) {
+        if (node != NULL && node->getType() == "subroutine") {
+            scopes.push_back(node);
+        }
+    }
+    for (ParseTree* under : scopes) {
+        vector<ParseTree*> scope = order;
+        if (under != NULL) {
+            unordered_map<ParseTree*, ParseTree*> unused;
+            scope.clear();
+            walk(under, NULL, scope, unused);
+            scope.erase(scope.begin());
+        }
+        for (string type : {"subroutine", "letStatement", "term", "identifier"}) {
+            vector<ParseTree*> expected;
+            for (ParseTree* node : scope) {
+                if (node != NULL && node->getType() == type) {
+                    expected.push_back(node);
+                }
+            }
+            if (index.find(type, under) != expected) {
+                fail("ParseTreeIndex::find(" + type + ") disagrees with a walk");
+            }
+        }
+        vector<ParseTree*> expected;
+        for (ParseTree* node : scope) {
+            if (node != NULL && node->getType() == "identifier" && node->getValue() == "a" && node->getChildren().empty()) {
+                expected.push_back(node);
+            }
+        }
+        if (index.find("identifier", "a", under) != expected) {
+            fail("ParseTreeIndex::find(identifier, a) disagrees with a walk");
+        }
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    ByteReader in(data, size);
+    if (in.pick(2) == 0) {
+        currentInput.clear();
+        while (!in.done()) {
+            const char** token = VOCABULARY[in.pick(VOCABULARY_SIZE)];
+            currentInput.push_back(vocabularyTable.intern(token[0], token[1]));
+        }
+    } else {
+        Generator generator(in, vocabularyTable);
+        currentInput = generator.generate();
+        mutate(currentInput, in, vocabularyTable);
+    }
+
+    // These parses run on the heap and are freed with ParseTree::destroy, so the sanitizer
+    // reports any node the parser leaks, including partial trees left by a ParseException
+    HashConsTable table;
+    HashConsTable otherTable;
+    ParseTree* plain = parse(currentInput, NULL, false);
+    ParseTree* shared = parse(currentInput, &table, false);
+    ParseTree* otherShared = parse(currentInput, &otherTable, false);
+    ParseTree* outline = parse(currentInput, NULL, true);
+    ParseTree* outlineShared = table.intern(parse(currentInput, &table, true));
+    ParseTree* outlineAgain = table.intern(parse(currentInput, &table, true));
+    ParseTree* copy = plain != NULL ? ParseTree::deserialize(plain->serialize()) : NULL;
+    if ((plain == NULL) != (shared == NULL)) {
+        fail("hash-consed parse disagrees on success");
+    }
+    if (plain != NULL) {
+        if (plain->tostring() != shared->tostring() || !plain->equals(shared)) {
+            fail("hash-consed parse produced a different tree");
+        }
+        if (!TreeDiff::diff(plain, shared).empty()) {
+            fail("TreeDiff reported edits between identical trees");
+        }
+        if (!shared->equals(otherShared)) {
+            fail("trees hash-consed by different tables compare unequal");
+        }
+        if (copy == NULL || copy->tostring() != plain->tostring() || copy->getHash() != plain->getHash()) {
+            fail("serialize/deserialize round trip changed the tree");
+        }
+        checkIndex(plain);
+        checkIndex(shared);
+    }
+
+    // Outline mode defers errors inside bodies, so it may only succeed where the plain parse failed
+    if (plain != NULL && outline == NULL) {
+        fail("outline parse failed on valid input");
+    }
+    if (plain != NULL && (!plain->equals(outline) || !TreeDiff::diff(outline, plain).empty())) {
+        fail("outline parse does not compare equal to the full parse");
+    }
+    if (plain != NULL && (!outlineShared->equals(plain) || !plain->equals(outlineAgain))) {
+        fail("interned outline parse does not compare equal to the full parse");
+    }
+    if (outline != NULL) {
+        string text;
+        try {
+            text = outline->tostring();
+        } catch (ParseException& e) {
+            text = "";
+        }
+        if (plain != NULL ? text != plain->tostring() : !text.empty()) {
+            fail("outline parse produced a different tree once loaded");
+        }
+    }
+
+    // The server parses in a NodePool, which must build the same tree
+    pool.activate();
+    ParseTree* pooled = parse(currentInput, NULL, false);
+    if (plain != NULL ? pooled == NULL || pooled->tostring() != plain->tostring() : pooled != NULL) {
+        fail("parse in a NodePool produced a different tree");
+    }
+    pool.deactivate();
+    pool.release();
+
+    // Shared nodes are skipped by destroy and freed with their tables
+    ParseTree::destroy(plain);
+    ParseTree::destroy(shared);
+    ParseTree::destroy(otherShared);
+    ParseTree::destroy(outline);
+    ParseTree::destroy(outlineShared);
+    ParseTree::destroy(outlineAgain);
+    ParseTree::destroy(copy);
+    return 0;
+}
+
+#ifdef FUZZ_WITH_LIBFUZZER
+extern "C" int LLVMFuzzerInitialize(int*, char***) {
+    checkTreeDiff();
+    return 0;
+}
+#else
+int main(int argc, char *argv[]) {
+    int seconds = argc > 1 ? atoi(argv[1]) : 10;
+    unsigned seed = argc > 2 ? atoi(argv[2]) : random_device()();
+    cout << "FuzzParser: running for " << seconds << "s with seed " << seed << endl;
+
+    typedef chrono::steady_clock Clock;
+    checkTreeDiff();
+    mt19937 rng(seed);
+    signal(SIGALRM, onTimeout);
+
+    Clock::time_point start = Clock::now();
+    Clock::time_point lastReport = start;
+    long execs = 0;
+    vector<uint8_t> input;
+    while (Clock::now() - start < chrono::seconds(seconds)) {
+        input.resize(rng() % 512);
+        for (uint8_t& byte : input) {
+            byte = rng();
+        }
+
+        alarm(2);
+        LLVMFuzzerTestOneInput(input.data(), input.size());
+        alarm(0);
+        execs++;
+
+        Clock::time_point now = Clock::now();
+        if (now - lastReport >= chrono::seconds(1)) {
+            double elapsed = chrono::duration<double>(now - start).count();
+            cout << "#" << execs << "  " << (long) (execs / elapsed) << " execs/s" << endl;
+            lastReport = now;
+        }
+    }
+
+    double elapsed = chrono::duration<double>(Clock::now() - start).count();
+    cout << "FuzzParser: " << execs << " execs in " << elapsed << "s, " << (long) (execs / elapsed) << " execs/s" << endl;
+    return 0;
+}
+#endif
@@ -0,0 +1,86 @@
+#include "HashConsTable.h"
+
+#include <atomic>
+
+using namespace std;
+
+static atomic<unsigned> nextTableId(1);
+
+/**
+ * An empty table. Each table gets its own ID, which shared nodes record as their owner,
+ * so nodes can tell tables apart without holding a pointer.
+ */
+HashConsTable::HashConsTable() {
+    id = nextTableId++;
+}
+
+/**
+ * Frees every shared node. Children of shared nodes are shared too, so each node is freed exactly once.
+ * Pooled nodes are left to their NodePool, which must not be released before the table is destroyed.
+ */
+HashConsTable::~HashConsTable() {
+    for (Shard& shard : shards) {
+        for (auto& entry : shard.nodes) {
+            if (!entry.second->pooled) {
+                delete entry.second;
+            }
+        }
+    }
+}
+
+/**
+ * Get the shared copy of a subtree. The subtree's children are interned first, so every
+ * node below a shared node is shared too. If an identical subtree is already in the table,
+ * the given one is destroyed and the existing one returned; otherwise the given one becomes
+ * the shared copy. Subtrees already owned by a table (this one or another) are kept as they are.
+ * Subtrees with a deferred node (from an outline parse) are never shared: their hash is not
+ * structural, and comparing them would load bodies, which intern through this table again.
+ * Only their fully built children are interned. Safe to call from several threads at once.
+ * @param tree The ParseTree to share, which must not be used after this call
+ * @return The shared ParseTree equal to tree
+ */
+ParseTree* HashConsTable::intern(ParseTree* tree) {
+    if (tree == NULL || tree->owner != 0) {
+        return tree;
+    }
+    for (ParseTree*& child : tree->children) {
+        child = intern(child);
+    }
+    if (tree->deferred) {
+        return tree;
+    }
+
+    Shard& shard = shards[tree->hash % SHARDS];
+    ParseTree* existing = NULL;
+    {
+        // Neither side has deferred children, so equals() cannot load a body while the lock is held
+        lock_guard<mutex> guard(shard.lock);
+        auto range = shard.nodes.equal_range(tree->hash);
+        for (auto it = range.first; it != range.second; it++) {
+            if (it->second->equals(tree)) {
+                existing = it->second;
+                break;
+            }
+        }
+        if (existing == NULL) {
+            tree->owner = id;
+            shard.nodes.emplace(tree->hash, tree);
+            return tree;
+        }
+    }
+    ParseTree::destroy(tree);
+    return existing;
+}
+
+/**
+ * Get the number of distinct shared subtrees
+ * @return The number of nodes in the table
+ */
+size_t HashConsTable::size() {
+    size_t total = 0;
+    for (Shard& shard : shards) {
+        lock_guard<mutex> guard(shard.lock);
+        total += shard.nodes.size();
+    }
+    return total;
+}
@@ -0,0 +1,32 @@
+#ifndef HASHCONSTABLE_H
+#define HASHCONSTABLE_H
+
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+
+#include "ParseTree.h"
+
+class HashConsTable {
+    private:
+        static const int SHARDS = 16;
+
+        struct Shard {
+            std::mutex lock;
+            std::unordered_multimap<size_t, ParseTree*> nodes;
+        };
+
+        Shard shards[SHARDS];
+        unsigned id;
+
+    public:
+        HashConsTable();
+
+        ~HashConsTable();
+
+        ParseTree* intern(ParseTree* tree);
+
+        size_t size();
+};
+
+#endif /*HASHCONSTABLE_H*/
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <fstream>
 #include <list>
 
 #include "CompilerParser.h"
@@ -7,24 +8,47 @@
 using namespace std;
 
 int main(int argc, char *argv[]) {
-    /* Tokens for:
-     *     class MyClass {
-     *
-     *     }
-     */
+    // --stats prints memory statistics for the parse after the tree
+    bool printStats = argc > 1 && string(argv[1]) == "--stats";
+    int fileArg = printStats ? 2 : 1;
+
     list<Token*> tokens;
-    tokens.push_back(new Token("keyword", "class"));
-    tokens.push_back(new Token("identifier", "MyClass"));
-    tokens.push_back(new Token("symbol", "{"));
-    tokens.push_back(new Token("symbol", "}"));
+    if (argc > fileArg) {
+        // Read tokens from a file, one "type value" pair per line
+        ifstream file(argv[fileArg]);
+        if (!file) {
+            cout << "Cannot open " << argv[fileArg] << endl;
+            return 1;
+        }
+        tokens = Token::read(file);
+    } else {
+        /* Tokens for:
+         *     class MyClass {
+         *
+         *     }
+         */
+        tokens.push_back(new Token("keyword", "class"));
+        tokens.push_back(new Token("identifier", "MyClass"));
+        tokens.push_back(new Token("symbol", "{"));
+        tokens.push_back(new Token("symbol", "}"));
+    }
 
     try {
         CompilerParser parser(tokens);
-        ParseTree* RE1ult = parser.compileProgram();
+        ParseStats stats;
+        ParseTree* RE1ult = printStats ? parser.compileProgram(&stats) : parser.compileProgram();
         if (RE1ult != NULL){
             cout << RE1ult->tostring() << endl;
         }
+        if (printStats) {
+            cout << stats.tostring();
+        }
+        ParseTree::destroy(RE1ult);
     } catch (ParseException e) {
         cout << "Error Parsing!" << endl;
     }
+
+    for (Token* token : tokens) {
+        delete token;
+    }
 }
\ No newline at end of file
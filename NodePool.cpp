@@ -0,0 +1,129 @@
+#include "NodePool.h"
+#include "ParseTree.h"
+
+#include <new>
+
+using namespace std;
+
+static thread_local NodePool* activePool = NULL;
+
+/**
+ * An arena for ParseTree nodes. While a pool is active, every ParseTree
+ * (and Token) created on this thread is carved out of the pool's chunks,
+ * and release() frees all of them at once while keeping the chunks warm
+ * for the next parse.
+ * @param chunkSize The number of bytes to reserve per chunk
+ */
+NodePool::NodePool(size_t chunkSize) {
+    NodePool::chunkSize = chunkSize;
+    NodePool::chunkIndex = 0;
+    NodePool::offset = 0;
+    NodePool::previous = NULL;
+}
+
+/**
+ * Destroys any remaining nodes and returns the chunks to the heap
+ */
+NodePool::~NodePool() {
+    if (activePool == this) {
+        deactivate();
+    }
+    release();
+    for (char* chunk : chunks) {
+        delete[] chunk;
+    }
+}
+
+/**
+ * Reserve memory for a node
+ * @param size The number of bytes needed
+ * @return A pointer to suitably aligned memory owned by this pool
+ */
+void* NodePool::allocate(size_t size) {
+    size_t align = alignof(max_align_t);
+    size = (size + align - 1) & ~(align - 1);
+
+    while (chunkIndex < chunks.size()) {
+        if (offset + size <= chunkSize) {
+            void* p = chunks[chunkIndex] + offset;
+            offset += size;
+            return p;
+        }
+        chunkIndex++;
+        offset = 0;
+    }
+
+    // Every chunk is full, so grow by one
+    if (size > chunkSize) {
+        throw bad_alloc();
+    }
+    chunks.push_back(new char[chunkSize]);
+    chunkIndex = chunks.size() - 1;
+    offset = size;
+    return chunks[chunkIndex];
+}
+
+/**
+ * Check if a pointer lies inside one of this pool's chunks.
+ * The chunk currently being filled is checked first, so a node that was just
+ * allocated is recognised in constant time; other pointers scan every chunk.
+ * @param p The pointer to check
+ * @return true if the memory belongs to this pool, false otherwise
+ */
+bool NodePool::owns(void* p) {
+    char* c = (char*) p;
+    if (chunkIndex < chunks.size() && c >= chunks[chunkIndex] && c < chunks[chunkIndex] + chunkSize) {
+        return true;
+    }
+    for (size_t i = chunks.size(); i > 0; i--) {
+        if (c >= chunks[i - 1] && c < chunks[i - 1] + chunkSize) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Record a constructed node so release() can destroy it
+ * @param node The node living in this pool
+ */
+void NodePool::track(ParseTree* node) {
+    nodes.push_back(node);
+}
+
+/**
+ * Make this pool the target for new nodes on the calling thread
+ */
+void NodePool::activate() {
+    previous = activePool;
+    activePool = this;
+}
+
+/**
+ * Stop allocating new nodes from this pool, restoring the previous one
+ */
+void NodePool::deactivate() {
+    activePool = previous;
+    previous = NULL;
+}
+
+/**
+ * Destroy every node allocated since the last release, keeping the chunks.
+ * Pointers into the released trees must not be used afterwards.
+ */
+void NodePool::release() {
+    for (size_t i = nodes.size(); i > 0; i--) {
+        nodes[i - 1]->~ParseTree();
+    }
+    nodes.clear();
+    chunkIndex = 0;
+    offset = 0;
+}
+
+/**
+ * Get the pool new nodes are allocated from on the calling thread
+ * @return The active pool, or NULL when nodes come from the heap
+ */
+NodePool* NodePool::active() {
+    return activePool;
+}
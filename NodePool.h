@@ -0,0 +1,38 @@
+#ifndef NODEPOOL_H
+#define NODEPOOL_H
+
+#include <cstddef>
+#include <vector>
+
+class ParseTree;
+
+class NodePool {
+    private:
+        std::vector<char*> chunks;
+        size_t chunkSize;
+        size_t chunkIndex;
+        size_t offset;
+        std::vector<ParseTree*> nodes;
+        NodePool* previous;
+
+    public:
+        NodePool(size_t chunkSize = 64 * 1024);
+
+        ~NodePool();
+
+        void* allocate(size_t size);
+
+        bool owns(void* p);
+
+        void track(ParseTree* node);
+
+        void activate();
+
+        void deactivate();
+
+        void release();
+
+        static NodePool* active();
+};
+
+#endif /*NODEPOOL_H*/
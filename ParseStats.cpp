@@ -0,0 +1,174 @@
+#include "ParseStats.h"
+
+#include <algorithm>
+
+using namespace std;
+
+static thread_local ParseStats* activeStats = NULL;
+
+/**
+ * Memory and size statistics for one parse. While activated, every ParseTree created on this
+ * thread reports its node, string and child-list allocations here, and reports them again as
+ * freed if it is destroyed while these stats are still active. What each node was charged is
+ * kept in a side table for the duration of the activation, so nodes carry no extra state and
+ * parses without stats pay nothing. Counts and allocated bytes
+ * are totals for the parse, including subtrees later dropped by hash-consing; currentBytes is what
+ * is still allocated and peakBytes its high-water mark.
+ */
+ParseStats::ParseStats() {
+    ParseStats::previous = NULL;
+    ParseStats::tokens = 0;
+    ParseStats::nodes = 0;
+    ParseStats::nodeBytes = 0;
+    ParseStats::stringBytes = 0;
+    ParseStats::childBytes = 0;
+    ParseStats::currentBytes = 0;
+    ParseStats::peakBytes = 0;
+}
+
+/**
+ * Start collecting allocations made on the calling thread
+ */
+void ParseStats::activate() {
+    previous = activeStats;
+    activeStats = this;
+}
+
+/**
+ * Stop collecting, restoring the previously active stats. Nodes still alive are no longer tracked,
+ * so freeing them later does not change currentBytes.
+ */
+void ParseStats::deactivate() {
+    activeStats = previous;
+    previous = NULL;
+    credited.clear();
+}
+
+/**
+ * Get the stats allocations are reported to on the calling thread
+ * @return The active stats, or NULL if none are being collected
+ */
+ParseStats* ParseStats::active() {
+    return activeStats;
+}
+
+/**
+ * Record a new node. Only nodes recorded here are charged for allocations and credited when freed.
+ * @param node The node
+ * @param type The type of node
+ */
+void ParseStats::countNode(const void* node, const string& type) {
+    nodes++;
+    nodesByType[type]++;
+    credited[node] = {0, 0};
+}
+
+/**
+ * Add bytes to one of the totals and to a counted node's charge
+ */
+void ParseStats::charge(size_t& total, size_t& charged, size_t bytes) {
+    total += bytes;
+    charged += bytes;
+    currentBytes += bytes;
+    peakBytes = max(peakBytes, currentBytes);
+}
+
+/**
+ * Record the memory for a node object
+ * @param node The node
+ * @param bytes The size of the allocation
+ */
+void ParseStats::allocateNode(const void* node, size_t bytes) {
+    auto found = credited.find(node);
+    if (found != credited.end()) {
+        charge(nodeBytes, found->second.bytes, bytes);
+    }
+}
+
+/**
+ * Record the heap buffer of a node's type or value
+ * @param node The node
+ * @param bytes The size of the allocation
+ */
+void ParseStats::allocateString(const void* node, size_t bytes) {
+    auto found = credited.find(node);
+    if (found != credited.end()) {
+        charge(stringBytes, found->second.bytes, bytes);
+    }
+}
+
+/**
+ * Record an entry in a node's child list. Entries of nodes created before these stats were
+ * activated are not counted.
+ * @param node The node the entry was added to
+ * @param bytes The size of the allocation
+ */
+void ParseStats::allocateChildren(const void* node, size_t bytes) {
+    auto found = credited.find(node);
+    if (found != credited.end()) {
+        charge(childBytes, found->second.childBytes, bytes);
+    }
+}
+
+/**
+ * Record that a node's child-list entries were moved onto another node without reallocating.
+ * If the new owner is not counted, the entries stay charged to the old one.
+ * @param from The node that gave up its entries
+ * @param to The node that took them over
+ */
+void ParseStats::moveChildren(const void* from, const void* to) {
+    auto source = credited.find(from);
+    auto target = credited.find(to);
+    if (source != credited.end() && target != credited.end()) {
+        target->second.childBytes += source->second.childBytes;
+        source->second.childBytes = 0;
+    }
+}
+
+/**
+ * Record a freed node. Only what the node was charged while these stats were active is given
+ * back, so nodes from before activation, or from other stats, change nothing.
+ * @param node The node being freed
+ */
+void ParseStats::deallocate(const void* node) {
+    auto found = credited.find(node);
+    if (found == credited.end()) {
+        return;
+    }
+    currentBytes -= found->second.bytes + found->second.childBytes;
+    credited.erase(found);
+}
+
+/**
+ * Get the number of heap bytes a string holds. Short strings are stored inside the string
+ * object itself and take none.
+ * @param text The string to measure
+ * @return The size of the string's heap buffer
+ */
+size_t ParseStats::heapBytes(const string& text) {
+    const char* data = text.data();
+    const char* object = (const char*) &text;
+    if (data >= object && data < object + sizeof(text)) {
+        return 0;
+    }
+    return text.capacity() + 1;
+}
+
+/**
+ * Generate a string from these stats
+ * @return A printable summary, one figure per line
+ */
+string ParseStats::tostring() {
+    string output = "";
+    output += "tokens " + to_string(tokens) + "\n";
+    output += "nodes " + to_string(nodes) + "\n";
+    for (auto& entry : nodesByType) {
+        output += "  " + entry.first + " " + to_string(entry.second) + "\n";
+    }
+    output += "node bytes " + to_string(nodeBytes) + "\n";
+    output += "string bytes " + to_string(stringBytes) + "\n";
+    output += "child bytes " + to_string(childBytes) + "\n";
+    output += "current bytes " + to_string(currentBytes) + "\n";
+    output += "peak bytes " + to_string(peakBytes) + "\n";
+    return output;
+}
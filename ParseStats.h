@@ -0,0 +1,59 @@
+#ifndef PARSESTATS_H
+#define PARSESTATS_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+class ParseStats {
+    private:
+        /**
+         * What one counted node has been charged: the node and its strings, and its child-list entries
+         */
+        struct Credit {
+            size_t bytes;
+            size_t childBytes;
+        };
+
+        ParseStats* previous;
+        std::unordered_map<const void*, Credit> credited;
+
+        void charge(size_t& total, size_t& charged, size_t bytes);
+
+    public:
+        size_t tokens;
+        size_t nodes;
+        std::map<std::string, size_t> nodesByType;
+        size_t nodeBytes;
+        size_t stringBytes;
+        size_t childBytes;
+        size_t currentBytes;
+        size_t peakBytes;
+
+        ParseStats();
+
+        void activate();
+
+        void deactivate();
+
+        static ParseStats* active();
+
+        void countNode(const void* node, const std::string& type);
+
+        void allocateNode(const void* node, size_t bytes);
+
+        void allocateString(const void* node, size_t bytes);
+
+        void allocateChildren(const void* node, size_t bytes);
+
+        void moveChildren(const void* from, const void* to);
+
+        void deallocate(const void* node);
+
+        static size_t heapBytes(const std::string& text);
+
+        std::string tostring();
+};
+
+#endif /*PARSESTATS_H*/
@@ -1,8 +1,35 @@
 #include "ParseTree.h"
 #include "Token.h"
+#include "NodePool.h"
+#include "ParseStats.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <mutex>
+#include <unordered_map>
 
 using namespace std;
 
+/**
+ * Bytes taken by one entry of a child list: the pointer plus the list's two links
+ */
+static const size_t CHILD_ENTRY_BYTES = sizeof(ParseTree*) + 2 * sizeof(void*);
+
+// ParseStats counts every node as sizeof(ParseTree), which is only exact while subclasses add no members
+static_assert(sizeof(Token) == sizeof(ParseTree), "Token must not add members to ParseTree");
+
+static mutex loadersLock;
+
+/**
+ * Get the loaders of nodes whose children have not been built yet. They are kept outside the
+ * nodes so only outline parses pay for them. The map is never destroyed, so nodes freed during
+ * static destruction (e.g. by a static NodePool) can still look it up.
+ */
+static unordered_map<const ParseTree*, ParseTreeLoader*>& loaders() {
+    static unordered_map<const ParseTree*, ParseTreeLoader*>* map = new unordered_map<const ParseTree*, ParseTreeLoader*>();
+    return *map;
+}
+
 /**
  * A node in a Parse Tree data structure
  * @param type The type of node (see element types).
@@ -12,21 +39,99 @@ using namespace std;
 ParseTree::ParseTree(string type, string value) {
     ParseTree::type = type;
     ParseTree::value = value;
+    ParseTree::hash = combineHash(std::hash<string>()(type), std::hash<string>()(value));
+    ParseTree::owner = 0;
+    ParseTree::deferred = false;
+    ParseTree::unloaded = false;
+
+    ParseStats* stats = ParseStats::active();
+    if (stats != NULL) {
+        stats->countNode(this, ParseTree::type);
+        stats->allocateNode(this, sizeof(ParseTree));
+        stats->allocateString(this, ParseStats::heapBytes(ParseTree::type) + ParseStats::heapBytes(ParseTree::value));
+    }
+
+    NodePool* pool = NodePool::active();
+    ParseTree::pooled = pool != NULL && pool->owns(this);
+    if (ParseTree::pooled) {
+        pool->track(this);
+    }
+}
+
+/**
+ * Frees the loader of a node whose children were never built, and reports the node's memory
+ * as freed to the active ParseStats if they counted it. This runs for pooled nodes too, when
+ * NodePool::release() destroys them.
+ */
+ParseTree::~ParseTree() {
+    if (ParseTree::unloaded) {
+        ParseTreeLoader* loader;
+        {
+            lock_guard<mutex> guard(loadersLock);
+            auto found = loaders().find(this);
+            loader = found->second;
+            loaders().erase(found);
+        }
+        delete loader;
+    }
+
+    ParseStats* stats = ParseStats::active();
+    if (stats != NULL) {
+        stats->deallocate(this);
+    }
+}
+
+/**
+ * Allocate a node from the active NodePool, or from the heap if there is none
+ * @param size The number of bytes needed
+ * @return Memory for the node
+ */
+void* ParseTree::operator new(size_t size) {
+    NodePool* pool = NodePool::active();
+    if (pool != NULL) {
+        return pool->allocate(size);
+    }
+    return ::operator new(size);
 }
 
 /**
- * Adds a ParseTree as a child of this ParseTree
+ * Free a heap node. Pooled nodes are only freed by NodePool::release().
+ * @param p The node's memory
+ */
+void ParseTree::operator delete(void* p) {
+    NodePool* pool = NodePool::active();
+    if (pool != NULL && pool->owns(p)) {
+        return;
+    }
+    ::operator delete(p);
+}
+
+/**
+ * Adds a ParseTree as a child of this ParseTree.
+ * Shared nodes cannot be changed, since that would alter every tree they appear in and leave
+ * them under a stale hash in their HashConsTable; adding to one throws std::logic_error.
  * @param child The ParseTree to add
  */
 void ParseTree::addChild(ParseTree* child) {
+    if (ParseTree::owner != 0) {
+        throw logic_error("Cannot add a child to a ParseTree shared through a HashConsTable");
+    }
     ParseTree::children.push_back(child);
+
+    ParseStats* stats = ParseStats::active();
+    if (stats != NULL) {
+        stats->allocateChildren(this, CHILD_ENTRY_BYTES);
+    }
+    ParseTree::hash = combineHash(ParseTree::hash, child != NULL ? child->hash : 0);
+    ParseTree::deferred = ParseTree::deferred || (child != NULL && child->deferred);
 }
 
 /**
  * Get a list of child nodes in the order they were added.
- * @return A LinkedList of ParseTrees
+ * @return A LinkedList of ParseTrees; references and iterators into it stay valid as children are added
  */
-list<ParseTree*> ParseTree::getChildren() {
+const list<ParseTree*>& ParseTree::getChildren() {
+    load();
     return ParseTree::children;
 }
 
@@ -46,6 +151,146 @@ string ParseTree::getValue() {
     return ParseTree::value;
 }
 
+/**
+ * Get the structural hash of this Node. It covers the type, the value and every child in order,
+ * and is kept up to date as children are added.
+ * @return The hash of the subtree rooted at this Node
+ */
+size_t ParseTree::getHash() {
+    return ParseTree::hash;
+}
+
+/**
+ * Check if this Node is owned by a HashConsTable. Shared nodes may appear in many trees and must not be modified.
+ * @return true if the node is shared, false otherwise
+ */
+bool ParseTree::isShared() {
+    return ParseTree::owner != 0;
+}
+
+/**
+ * Mark this node's children as not built yet. They are built by the loader the first time they
+ * are needed (getChildren, equals, tostring or serialize), after which the loader is freed.
+ * Until then the node reports the given hash, which it keeps after loading so that the hashes of
+ * its ancestors stay valid. Such hashes are not comparable with structural ones, so equals() only
+ * trusts a hash mismatch between nodes that both do, or both do not, have a deferred node below them.
+ * @param loader The loader to build the children with, owned by this node from now on
+ * @param hash The hash to report for this node
+ */
+void ParseTree::defer(ParseTreeLoader* loader, size_t hash) {
+    ParseTreeLoader* previous = NULL;
+    {
+        lock_guard<mutex> guard(loadersLock);
+        ParseTreeLoader*& entry = loaders()[this];
+        if (ParseTree::unloaded) {
+            previous = entry;
+        }
+        entry = loader;
+    }
+    delete previous;
+    ParseTree::unloaded = true;
+    ParseTree::hash = hash;
+    ParseTree::deferred = true;
+}
+
+/**
+ * Check if this node's children have been built
+ * @return false if the node is still waiting on its loader, true otherwise
+ */
+bool ParseTree::isLoaded() {
+    return !ParseTree::unloaded;
+}
+
+/**
+ * Build deferred children. If the loader throws, the node stays deferred.
+ */
+void ParseTree::load() {
+    if (!ParseTree::unloaded) {
+        return;
+    }
+    ParseTreeLoader* loader;
+    {
+        lock_guard<mutex> guard(loadersLock);
+        loader = loaders()[this];
+    }
+    // The loader runs without the lock, since it builds (and may defer) nodes of its own
+    ParseTree* loaded = loader->load();
+    ParseTree::children.splice(ParseTree::children.end(), loaded->children);
+    ParseStats* stats = ParseStats::active();
+    if (stats != NULL) {
+        stats->moveChildren(loaded, this);
+    }
+    destroy(loaded);
+    {
+        lock_guard<mutex> guard(loadersLock);
+        loaders().erase(this);
+    }
+    delete loader;
+    ParseTree::unloaded = false;
+}
+
+/**
+ * Mix a value into a running hash (order-sensitive)
+ * @param seed The hash so far
+ * @param value The hash of the next item
+ * @return The combined hash
+ */
+size_t ParseTree::combineHash(size_t seed, size_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+/**
+ * Check if two subtrees are structurally identical.
+ * Nodes shared through the same HashConsTable are equal only if they are the same node, so this is O(1)
+ * for trees hash-consed by one table. Nodes owned by different tables are compared structurally.
+ * A subtree that was deferred is hashed differently from one that was parsed right away, so comparing
+ * an outline tree with a full parse skips the hash check and loads the deferred children.
+ * @param other The ParseTree to compare with
+ * @return true if both subtrees have the same types, values and children
+ */
+bool ParseTree::equals(ParseTree* other) {
+    if (this == other) {
+        return true;
+    }
+    if (other == NULL) {
+        return false;
+    }
+    if (ParseTree::deferred == other->deferred && ParseTree::hash != other->hash) {
+        return false;
+    }
+    if (ParseTree::owner != 0 && ParseTree::owner == other->owner) {
+        return false;
+    }
+    load();
+    other->load();
+    if (ParseTree::type != other->type || ParseTree::value != other->value || ParseTree::children.size() != other->children.size()) {
+        return false;
+    }
+    auto mine = ParseTree::children.begin();
+    for (ParseTree* theirs : other->children) {
+        if (*mine != theirs && (*mine == NULL || !(*mine)->equals(theirs))) {
+            return false;
+        }
+        mine++;
+    }
+    return true;
+}
+
+/**
+ * Delete a heap-allocated ParseTree and its children.
+ * Shared nodes belong to their HashConsTable and pooled nodes to their NodePool, so both are left alone.
+ * @param tree The ParseTree to delete
+ */
+void ParseTree::destroy(ParseTree* tree) {
+    if (tree == NULL || tree->owner != 0 || tree->pooled) {
+        return;
+    }
+    for (ParseTree* child : tree->children) {
+        destroy(child);
+    }
+    delete tree;
+}
+
 /**
  * Generate a string from this ParseTree
  * @return A printable representation of this ParseTree
@@ -59,6 +304,8 @@ string ParseTree::tostring() {
  * @return A printable representation of this ParseTree with indentation
  */
 string ParseTree::tostring(int depth) {
+    load();
+
     // Set indentation
     string indent = "";
     for (int i = 0; i < depth; i++) {
@@ -79,4 +326,61 @@ string ParseTree::tostring(int depth) {
         output += ParseTree::type + " " + ParseTree::value + "\n";
     }
     return output;
-}
\ No newline at end of file
+}
+
+/**
+ * Serialize this ParseTree into a compact form that can be sent to another process.
+ * Each node is one line in pre-order: the number of children, the type and the value.
+ * @return The serialized tree
+ */
+string ParseTree::serialize() {
+    load();
+    string output = to_string(ParseTree::children.size()) + " " + ParseTree::type + " " + ParseTree::value + "\n";
+    for (ParseTree* child : children) {
+        output += child->serialize();
+    }
+    return output;
+}
+
+/**
+ * Read one node and its children from a serialized stream
+ * @return The rebuilt ParseTree, or NULL if the stream is malformed
+ */
+static ParseTree* readTree(istringstream& in) {
+    string line;
+    if (!getline(in, line)) {
+        return NULL;
+    }
+    size_t typeStart = line.find(' ');
+    size_t valueStart = line.find(' ', typeStart + 1);
+    if (typeStart == string::npos || valueStart == string::npos) {
+        return NULL;
+    }
+    // The child count must be a plain decimal that fits in an int; longer ones would make stoi throw
+    if (typeStart == 0 || typeStart > 9 || line.find_first_not_of("0123456789") != typeStart) {
+        return NULL;
+    }
+
+    int count = stoi(line.substr(0, typeStart));
+    ParseTree* tree = new ParseTree(line.substr(typeStart + 1, valueStart - typeStart - 1), line.substr(valueStart + 1));
+    for (int i = 0; i < count; i++) {
+        ParseTree* child = readTree(in);
+        if (child == NULL) {
+            // Free the children read so far rather than leaking the partial tree
+            ParseTree::destroy(tree);
+            return NULL;
+        }
+        tree->addChild(child);
+    }
+    return tree;
+}
+
+/**
+ * Rebuild a ParseTree from the output of serialize()
+ * @param text The serialized tree
+ * @return The rebuilt ParseTree, or NULL if the text is malformed
+ */
+ParseTree* ParseTree::deserialize(string text) {
+    istringstream in(text);
+    return readTree(in);
+}
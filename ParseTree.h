@@ -1,29 +1,77 @@
 #ifndef PARSETREE_H
 #define PARSETREE_H
 
+#include <cstddef>
 #include <string>
 #include <list>
 
+class ParseTree;
+class HashConsTable;
+
+/**
+ * Builds the children of a node on first access (see ParseTree::defer).
+ * load() returns a fresh node whose children are moved onto the deferred node.
+ */
+class ParseTreeLoader {
+    public:
+        virtual ~ParseTreeLoader() {}
+
+        virtual ParseTree* load() = 0;
+};
+
 class ParseTree {
     private:
         std::string type;
         std::string value;
         std::list<ParseTree*> children;
+        size_t hash;
+        unsigned owner;
+        bool pooled;
+        bool deferred;
+        bool unloaded;
+
+        friend class HashConsTable;
+
+        void load();
 
     public:
         ParseTree(std::string type, std::string value);
 
+        ~ParseTree();
+
+        static void* operator new(size_t size);
+
+        static void operator delete(void* p);
+
         void addChild(ParseTree* child);
 
-        std::list<ParseTree*> getChildren();
+        const std::list<ParseTree*>& getChildren();
 
         std::string getType();
 
         std::string getValue();
 
+        size_t getHash();
+
+        bool isShared();
+
+        void defer(ParseTreeLoader* loader, size_t hash);
+
+        bool isLoaded();
+
+        static size_t combineHash(size_t seed, size_t value);
+
+        bool equals(ParseTree* other);
+
+        static void destroy(ParseTree* tree);
+
         std::string tostring();
 
         std::string tostring(int depth);
+
+        std::string serialize();
+
+        static ParseTree* deserialize(std::string text);
 };
 
 #endif /*PARSETREE_H*/
\ No newline at end of file
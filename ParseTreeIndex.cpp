@@ -0,0 +1,153 @@
+#include "ParseTreeIndex.h"
+
+#include <algorithm>
+
+using namespace std;
+
+/**
+ * An index over a finished ParseTree for repeated queries. Nodes are numbered in pre-order,
+ * so the descendants of a node are the IDs between its own ID and its end. For each node type
+ * (and each type and value of a leaf) the index keeps a sorted list of IDs, which makes a query
+ * a binary search followed by a copy of the matches instead of a walk over the whole tree.
+ * The tree must not be modified while the index is in use.
+ * @param root The ParseTree to index, usually the result of compileProgram()
+ */
+ParseTreeIndex::ParseTreeIndex(ParseTree* root) {
+    if (root == NULL) {
+        return;
+    }
+
+    // Pre-order walk with an explicit stack; a node's end is set once all its descendants are numbered
+    vector<pair<ParseTree*, int>> stack;
+    stack.push_back({root, -1});
+    vector<int> open;
+    while (!stack.empty()) {
+        ParseTree* node = stack.back().first;
+        int parent = stack.back().second;
+        stack.pop_back();
+
+        while (!open.empty() && open.back() != parent) {
+            ends[open.back()] = nodes.size();
+            open.pop_back();
+        }
+
+        int id = nodes.size();
+        nodes.push_back(node);
+        parents.push_back(parent);
+        ends.push_back(id + 1);
+        open.push_back(id);
+        if (node == NULL) {
+            continue;
+        }
+        ids.emplace(node, id);
+
+        const list<ParseTree*>& children = node->getChildren();
+        byType[node->getType()].push_back(id);
+        if (children.empty()) {
+            byValue[node->getType() + '\0' + node->getValue()].push_back(id);
+        }
+        for (auto it = children.rbegin(); it != children.rend(); it++) {
+            stack.push_back({*it, id});
+        }
+    }
+    for (int id : open) {
+        ends[id] = nodes.size();
+    }
+}
+
+/**
+ * Get the number of nodes in the indexed tree
+ * @return The number of nodes
+ */
+size_t ParseTreeIndex::size() {
+    return nodes.size();
+}
+
+/**
+ * Get the pre-order ID of a node. A subtree shared through a HashConsTable can appear
+ * more than once; its first appearance is returned.
+ * @param node The node to look up
+ * @return The node's ID, or -1 if it is not in the tree
+ */
+int ParseTreeIndex::getId(ParseTree* node) {
+    auto found = ids.find(node);
+    if (found == ids.end()) {
+        return -1;
+    }
+    return found->second;
+}
+
+/**
+ * Get a node by its pre-order ID
+ * @param id The node's ID
+ * @return The node, or NULL if the ID is out of range
+ */
+ParseTree* ParseTreeIndex::getNode(int id) {
+    if (id < 0 || id >= (int) nodes.size()) {
+        return NULL;
+    }
+    return nodes[id];
+}
+
+/**
+ * Get the parent of a node. On a hash-consed tree (a DAG) a shared node can have several
+ * parents; only its first appearance in pre-order is resolved.
+ * @param node The node to look up
+ * @return The parent, or NULL for the root and for nodes not in the tree
+ */
+ParseTree* ParseTreeIndex::getParent(ParseTree* node) {
+    int id = getId(node);
+    if (id < 0 || parents[id] < 0) {
+        return NULL;
+    }
+    return nodes[parents[id]];
+}
+
+/**
+ * Find every node of a type. Shared subtrees are reported once per appearance.
+ * @param type The node type, e.g. "subroutine" or "letStatement"
+ * @param under If given, only descendants of this node are returned; if it is shared, those of its first appearance
+ * @return The matching nodes in tree order
+ */
+vector<ParseTree*> ParseTreeIndex::find(string type, ParseTree* under) {
+    return lookup(byType, type, under);
+}
+
+/**
+ * Find every leaf with a type and value, e.g. all identifiers named "x"
+ * @param type The node type
+ * @param value The node's value
+ * @param under If given, only descendants of this node are returned; if it is shared, those of its first appearance
+ * @return The matching nodes in tree order
+ */
+vector<ParseTree*> ParseTreeIndex::find(string type, string value, ParseTree* under) {
+    return lookup(byValue, type + '\0' + value, under);
+}
+
+/**
+ * Copy the IDs of one key that fall inside a subtree
+ */
+vector<ParseTree*> ParseTreeIndex::lookup(unordered_map<string, vector<int>>& table, string key, ParseTree* under) {
+    vector<ParseTree*> matches;
+    auto found = table.find(key);
+    if (found == table.end()) {
+        return matches;
+    }
+    vector<int>& list = found->second;
+
+    auto first = list.begin();
+    auto last = list.end();
+    if (under != NULL) {
+        int id = getId(under);
+        if (id < 0) {
+            return matches;
+        }
+        first = upper_bound(list.begin(), list.end(), id);
+        last = lower_bound(first, list.end(), ends[id]);
+    }
+    matches.reserve(last - first);
+    for (auto it = first; it != last; it++) {
+        matches.push_back(nodes[*it]);
+    }
+    return matches;
+}
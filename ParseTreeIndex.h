@@ -0,0 +1,37 @@
+#ifndef PARSETREEINDEX_H
+#define PARSETREEINDEX_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "ParseTree.h"
+
+class ParseTreeIndex {
+    private:
+        std::vector<ParseTree*> nodes;
+        std::vector<int> parents;
+        std::vector<int> ends;
+        std::unordered_map<std::string, std::vector<int>> byType;
+        std::unordered_map<std::string, std::vector<int>> byValue;
+        std::unordered_map<ParseTree*, int> ids;
+
+        std::vector<ParseTree*> lookup(std::unordered_map<std::string, std::vector<int>>& table, std::string key, ParseTree* under);
+
+    public:
+        ParseTreeIndex(ParseTree* root);
+
+        size_t size();
+
+        int getId(ParseTree* node);
+
+        ParseTree* getNode(int id);
+
+        ParseTree* getParent(ParseTree* node);
+
+        std::vector<ParseTree*> find(std::string type, ParseTree* under = NULL);
+
+        std::vector<ParseTree*> find(std::string type, std::string value, ParseTree* under = NULL);
+};
+
+#endif /*PARSETREEINDEX_H*/
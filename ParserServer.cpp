@@ -0,0 +1,411 @@
+#include "ParserServer.h"
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <map>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+/*
+ * Wire format (all counts are decimal, every header ends with a newline):
+ *   request:  "BATCH <n>" followed by n items of "FILE <len>" or "SOURCE <len>" and <len> bytes
+ *             (a FILE path is opened by the server, so clients should send absolute paths)
+ *   response: "BATCH <n>" followed by n items of "TREE <len>" or "ERROR <len>" and <len> bytes
+ *   "SHUTDOWN" stops the server.
+ */
+
+/**
+ * Write a whole buffer to a socket
+ * @return true on success, false if the peer went away
+ */
+static bool writeAll(int fd, string data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+    return true;
+}
+
+/**
+ * Pull more bytes from a socket into the read buffer
+ * @return false at end of stream
+ */
+static bool fill(int fd, string& buffer) {
+    char chunk[64 * 1024];
+    ssize_t n = ::read(fd, chunk, sizeof(chunk));
+    if (n <= 0) {
+        return false;
+    }
+    buffer.append(chunk, n);
+    return true;
+}
+
+/**
+ * Parse a decimal count from a header
+ * @return false if the text is not a number
+ */
+static bool readCount(string text, size_t& count) {
+    if (text.empty() || text.size() > 18 || text.find_first_not_of("0123456789") != string::npos) {
+        return false;
+    }
+    count = stoul(text);
+    return true;
+}
+
+/**
+ * Read one newline-terminated header from a socket
+ * @return false at end of stream
+ */
+static bool readLine(int fd, string& buffer, string& line) {
+    size_t end;
+    while ((end = buffer.find('\n')) == string::npos) {
+        if (!fill(fd, buffer)) {
+            return false;
+        }
+    }
+    line = buffer.substr(0, end);
+    buffer.erase(0, end + 1);
+    return true;
+}
+
+/**
+ * Read exactly len bytes of payload from a socket
+ * @return false at end of stream
+ */
+static bool readExact(int fd, string& buffer, size_t len, string& data) {
+    while (buffer.size() < len) {
+        if (!fill(fd, buffer)) {
+            return false;
+        }
+    }
+    data = buffer.substr(0, len);
+    buffer.erase(0, len);
+    return true;
+}
+
+/**
+ * Read one "<word> <len>" header and its payload
+ * @return false at end of stream or on a malformed header
+ */
+static bool readItem(int fd, string& buffer, string& kind, string& data) {
+    string line;
+    if (!readLine(fd, buffer, line)) {
+        return false;
+    }
+    size_t split = line.find(' ');
+    if (split == string::npos) {
+        return false;
+    }
+    size_t len;
+    if (!readCount(line.substr(split + 1), len)) {
+        return false;
+    }
+    kind = line.substr(0, split);
+    return readExact(fd, buffer, len, data);
+}
+
+/**
+ * Open a connected Unix domain socket
+ * @param socketPath The filesystem path of the socket
+ * @param server If true, bind and listen instead of connecting
+ * @return The socket file descriptor
+ */
+static int openSocket(string socketPath, bool server) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        throw runtime_error("Socket path too long: " + socketPath);
+    }
+    strcpy(addr.sun_path, socketPath.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        throw runtime_error("Cannot create socket");
+    }
+    if (server) {
+        // Only replace a stale socket left by an earlier server, never any other kind of file
+        struct stat existing;
+        if (lstat(socketPath.c_str(), &existing) == 0) {
+            if (!S_ISSOCK(existing.st_mode)) {
+                close(fd);
+                throw runtime_error(socketPath + " exists and is not a socket");
+            }
+            unlink(socketPath.c_str());
+        }
+        if (bind(fd, (sockaddr*) &addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+            close(fd);
+            throw runtime_error("Cannot listen on " + socketPath);
+        }
+    } else if (connect(fd, (sockaddr*) &addr, sizeof(addr)) < 0) {
+        close(fd);
+        throw runtime_error("Cannot connect to " + socketPath);
+    }
+    return fd;
+}
+
+/**
+ * A long-lived parser that answers batches of parse requests over a Unix domain socket.
+ * The parser and its node pool are kept between requests, so only the first
+ * request pays for warming them up. Tokens are shared across the files of one
+ * batch and freed when the batch has been answered, so the token table only
+ * grows with the size of a batch rather than with the server's lifetime.
+ * @param socketPath The filesystem path to listen on
+ */
+ParserServer::ParserServer(string socketPath) : parser(list<Token*>()) {
+    ParserServer::socketPath = socketPath;
+    ParserServer::listenFd = openSocket(socketPath, true);
+}
+
+/**
+ * Closes and removes the socket
+ */
+ParserServer::~ParserServer() {
+    close(listenFd);
+    unlink(socketPath.c_str());
+}
+
+/**
+ * Serve every connected client until one asks the server to shut down. Connections are
+ * multiplexed with poll(), and a batch is only parsed once all of its bytes have arrived,
+ * so an idle or slow client never holds up the others. A client that stops reading its
+ * answers is dropped once a write has been blocked for five seconds.
+ */
+void ParserServer::run() {
+    vector<pollfd> fds;
+    fds.push_back({listenFd, POLLIN, 0});
+    map<int, string> buffers;
+    bool running = true;
+    while (running) {
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error("poll failed");
+        }
+
+        // Walk backwards so closing a connection does not move the ones still to be checked
+        for (size_t i = fds.size() - 1; i > 0; i--) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+            int fd = fds[i].fd;
+            Status status = fill(fd, buffers[fd]) ? serve(fd, buffers[fd]) : CLOSE;
+            if (status == SHUTDOWN) {
+                running = false;
+            }
+            if (status != KEEP_OPEN) {
+                close(fd);
+                buffers.erase(fd);
+                fds.erase(fds.begin() + i);
+            }
+        }
+
+        if (running && (fds[0].revents & POLLIN)) {
+            int fd = accept(listenFd, NULL, NULL);
+            if (fd >= 0) {
+                timeval timeout = {5, 0};
+                setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                fds.push_back({fd, POLLIN, 0});
+            }
+        }
+    }
+    for (size_t i = 1; i < fds.size(); i++) {
+        close(fds[i].fd);
+    }
+}
+
+/**
+ * Find one "<word> <len>" header and its payload in bytes already received, without copying the payload
+ * @param pos Where the item starts; moved past it when the item is complete
+ * @return 1 if the item is complete, 0 if more bytes are needed, -1 if the header is malformed
+ */
+static int takeItem(const string& buffer, size_t& pos, string& kind, size_t& dataStart, size_t& len) {
+    size_t end = buffer.find('\n', pos);
+    if (end == string::npos) {
+        return 0;
+    }
+    size_t split = buffer.find(' ', pos);
+    if (split == string::npos || split > end || !readCount(buffer.substr(split + 1, end - split - 1), len)) {
+        return -1;
+    }
+    if (buffer.size() - (end + 1) < len) {
+        return 0;
+    }
+    kind = buffer.substr(pos, split - pos);
+    dataStart = end + 1;
+    pos = dataStart + len;
+    return 1;
+}
+
+/**
+ * Answer every complete batch a client has sent so far
+ * @param fd The connected socket
+ * @param buffer The bytes received on this connection and not answered yet
+ * @return Whether to keep the connection open, close it, or shut the server down
+ */
+ParserServer::Status ParserServer::serve(int fd, string& buffer) {
+    while (true) {
+        size_t end = buffer.find('\n');
+        if (end == string::npos) {
+            return KEEP_OPEN;
+        }
+        string line = buffer.substr(0, end);
+        if (line == "SHUTDOWN") {
+            return SHUTDOWN;
+        }
+        size_t count;
+        if (line.compare(0, 6, "BATCH ") != 0 || !readCount(line.substr(6), count)) {
+            return CLOSE;
+        }
+
+        // Check the whole batch has arrived before parsing any of it
+        vector<string> kinds;
+        vector<pair<size_t, size_t>> payloads;
+        size_t pos = end + 1;
+        for (size_t i = 0; i < count; i++) {
+            string kind;
+            size_t dataStart;
+            size_t len;
+            int status = takeItem(buffer, pos, kind, dataStart, len);
+            if (status < 0) {
+                return CLOSE;
+            }
+            if (status == 0) {
+                return KEEP_OPEN;
+            }
+            kinds.push_back(kind);
+            payloads.push_back({dataStart, len});
+        }
+
+        string response = "BATCH " + to_string(count) + "\n";
+        for (size_t i = 0; i < count; i++) {
+            ParserResult result = answer(kinds[i], buffer.substr(payloads[i].first, payloads[i].second));
+            response += string(result.ok ? "TREE " : "ERROR ") + to_string(result.text.size()) + "\n" + result.text;
+        }
+        table.clear();
+        buffer.erase(0, pos);
+        if (!writeAll(fd, response)) {
+            return CLOSE;
+        }
+    }
+}
+
+/**
+ * Read the tokens of one batch item and parse them
+ * @param kind "FILE" for a path on the server, "SOURCE" for token text
+ * @param data The path or the token text
+ * @return The serialized tree, or a diagnostic
+ */
+ParserResult ParserServer::answer(string kind, string data) {
+    try {
+        if (kind == "FILE") {
+            ifstream file(data);
+            if (!file) {
+                return {false, "Cannot open " + data};
+            }
+            return parse(Token::read(file, &table));
+        }
+        if (kind == "SOURCE") {
+            istringstream source(data);
+            return parse(Token::read(source, &table));
+        }
+        return {false, "Unknown request " + kind};
+    } catch (exception& e) {
+        // Reading the tokens happens outside parse(), so it needs its own handler
+        return {false, e.what()};
+    }
+}
+
+/**
+ * Parse one token list with the warm parser. Every node is allocated from the
+ * server's pool and released as soon as the tree has been serialized.
+ * Any exception (a syntax error, or running out of memory) becomes an error result
+ * for this item only; the pool is always deactivated and released.
+ * @param tokens The tokens to parse, owned by the token table
+ * @return The serialized tree, or a diagnostic
+ */
+ParserResult ParserServer::parse(list<Token*> tokens) {
+    ParserResult result;
+    pool.activate();
+    try {
+        parser.reset(tokens);
+        ParseTree* tree = parser.compileProgram();
+        if (tree != NULL) {
+            result = {true, tree->serialize()};
+        } else {
+            result = {false, "No parse tree"};
+        }
+    } catch (ParseException& e) {
+        result = {false, e.what()};
+    } catch (exception& e) {
+        result = {false, e.what()};
+    }
+    pool.deactivate();
+    pool.release();
+    return result;
+}
+
+/**
+ * A connection to a running ParserServer
+ * @param socketPath The filesystem path the server listens on
+ */
+ParserClient::ParserClient(string socketPath) {
+    ParserClient::fd = openSocket(socketPath, false);
+}
+
+/**
+ * Closes the connection
+ */
+ParserClient::~ParserClient() {
+    close(fd);
+}
+
+/**
+ * Send one batch and wait for all of its results
+ * @param batch The files or token texts to parse
+ * @return One result per request, in the same order
+ */
+vector<ParserResult> ParserClient::parse(vector<ParserRequest> batch) {
+    string request = "BATCH " + to_string(batch.size()) + "\n";
+    for (ParserRequest& item : batch) {
+        request += string(item.isFile ? "FILE " : "SOURCE ") + to_string(item.data.size()) + "\n" + item.data;
+    }
+    if (!writeAll(fd, request)) {
+        throw runtime_error("Server closed the connection");
+    }
+
+    string line;
+    if (!readLine(fd, buffer, line) || line != "BATCH " + to_string(batch.size())) {
+        throw runtime_error("Malformed response from server");
+    }
+    vector<ParserResult> results;
+    for (size_t i = 0; i < batch.size(); i++) {
+        string kind;
+        string data;
+        if (!readItem(fd, buffer, kind, data)) {
+            throw runtime_error("Malformed response from server");
+        }
+        results.push_back({kind == "TREE", data});
+    }
+    return results;
+}
+
+/**
+ * Ask the server to stop once this connection closes
+ */
+void ParserClient::shutdown() {
+    writeAll(fd, "SHUTDOWN\n");
+}
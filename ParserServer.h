@@ -0,0 +1,66 @@
+#ifndef PARSERSERVER_H
+#define PARSERSERVER_H
+
+#include <string>
+#include <list>
+#include <vector>
+
+#include "CompilerParser.h"
+#include "NodePool.h"
+#include "Token.h"
+
+/**
+ * One item of a batch: either the path of a token file the server should read,
+ * or the token text itself.
+ */
+struct ParserRequest {
+    bool isFile;
+    std::string data;
+};
+
+/**
+ * The server's answer for one item: a serialized ParseTree, or a diagnostic.
+ */
+struct ParserResult {
+    bool ok;
+    std::string text;
+};
+
+class ParserServer {
+    private:
+        std::string socketPath;
+        int listenFd;
+        CompilerParser parser;
+        NodePool pool;
+        TokenTable table;
+
+        enum Status { KEEP_OPEN, CLOSE, SHUTDOWN };
+
+        Status serve(int fd, std::string& buffer);
+        ParserResult answer(std::string kind, std::string data);
+        ParserResult parse(std::list<Token*> tokens);
+
+    public:
+        ParserServer(std::string socketPath);
+
+        ~ParserServer();
+
+        void run();
+};
+
+class ParserClient {
+    private:
+        int fd;
+        std::string buffer;
+
+    public:
+        ParserClient(std::string socketPath);
+
+        ~ParserClient();
+
+        std::vector<ParserResult> parse(std::vector<ParserRequest> batch);
+
+        void shutdown();
+};
+
+#endif /*PARSERSERVER_H*/
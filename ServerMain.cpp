@@ -0,0 +1,194 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ParserServer.h"
+
+using namespace std;
+
+/**
+ * Resolve a token file path against the client's working directory, since the server
+ * opens FILE items relative to its own
+ * @return The absolute path, or the path unchanged if it cannot be resolved
+ */
+static string absolutePath(string path) {
+    char resolved[PATH_MAX];
+    if (realpath(path.c_str(), resolved) == NULL) {
+        return path;
+    }
+    return resolved;
+}
+
+/**
+ * Run a per-process parse the way Main is normally used
+ * @return true if the process exited cleanly
+ */
+static bool runMain(string mainPath, string tokenFile) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, STDOUT_FILENO);
+        execl(mainPath.c_str(), mainPath.c_str(), tokenFile.c_str(), (char*) NULL);
+        _exit(127);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Compare the per-process Main flow against a running server on one token file
+ */
+static int bench(string socketPath, string mainPath, string tokenFile, int iterations) {
+    typedef chrono::steady_clock Clock;
+
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        if (!runMain(mainPath, tokenFile)) {
+            cout << "Main failed on " << tokenFile << endl;
+            return 1;
+        }
+    }
+    double processSeconds = chrono::duration<double>(Clock::now() - start).count();
+
+    ParserClient client(socketPath);
+    vector<ParserRequest> single = {{true, absolutePath(tokenFile)}};
+    start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        client.parse(single);
+    }
+    double latencySeconds = chrono::duration<double>(Clock::now() - start).count();
+
+    vector<ParserRequest> batch(iterations, {true, absolutePath(tokenFile)});
+    start = Clock::now();
+    client.parse(batch);
+    double batchSeconds = chrono::duration<double>(Clock::now() - start).count();
+
+    cout << "per-process Main: " << processSeconds * 1e6 / iterations << " us/file, "
+         << iterations / processSeconds << " files/s" << endl;
+    cout << "server, 1/batch:  " << latencySeconds * 1e6 / iterations << " us/file, "
+         << iterations / latencySeconds << " files/s" << endl;
+    cout << "server, " << iterations << "/batch: " << batchSeconds * 1e6 / iterations << " us/file, "
+         << iterations / batchSeconds << " files/s" << endl;
+    return 0;
+}
+
+/**
+ * Compare parsing one token file with nodes on the heap against nodes in a warm NodePool.
+ * Each heap parse is freed with ParseTree::destroy, each pooled parse with NodePool::release,
+ * so both timings include freeing the tree the way the server would.
+ */
+static int benchPool(string tokenFile, int iterations) {
+    typedef chrono::steady_clock Clock;
+
+    ifstream file(tokenFile);
+    if (!file) {
+        cout << "Cannot open " << tokenFile << endl;
+        return 1;
+    }
+    TokenTable table;
+    list<Token*> tokens = Token::read(file, &table);
+    CompilerParser parser(tokens);
+
+    double heapSeconds = 0;
+    double poolSeconds = 0;
+    NodePool pool;
+    for (int i = 0; i < iterations; i++) {
+        Clock::time_point start = Clock::now();
+        parser.reset(tokens);
+        ParseTree::destroy(parser.compileProgram());
+        heapSeconds += chrono::duration<double>(Clock::now() - start).count();
+
+        start = Clock::now();
+        pool.activate();
+        parser.reset(tokens);
+        parser.compileProgram();
+        pool.deactivate();
+        pool.release();
+        poolSeconds += chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    cout << "heap: " << heapSeconds * 1e3 / iterations << " ms/parse" << endl;
+    cout << "pool: " << poolSeconds * 1e3 / iterations << " ms/parse" << endl;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        cout << "usage: " << argv[0] << " serve <socket>" << endl;
+        cout << "       " << argv[0] << " client <socket> [--source] <token-file>..." << endl;
+        cout << "       " << argv[0] << " bench <socket> <Main-binary> <token-file> <iterations>" << endl;
+        cout << "       " << argv[0] << " shutdown <socket>" << endl;
+        cout << "       " << argv[0] << " pool <token-file> <iterations>" << endl;
+        return 2;
+    }
+    string mode = argv[1];
+    string socketPath = argv[2];
+
+    try {
+        if (mode == "serve") {
+            ParserServer server(socketPath);
+            server.run();
+            return 0;
+        }
+
+        if (mode == "bench" && argc == 6) {
+            return bench(socketPath, argv[3], argv[4], stoi(argv[5]));
+        }
+
+        if (mode == "pool" && argc == 4) {
+            return benchPool(argv[2], stoi(argv[3]));
+        }
+
+        if (mode == "shutdown") {
+            ParserClient client(socketPath);
+            client.shutdown();
+            return 0;
+        }
+
+        if (mode == "client") {
+            // With --source the client sends file contents instead of paths
+            bool sendSource = argc > 3 && string(argv[3]) == "--source";
+            vector<ParserRequest> batch;
+            for (int i = sendSource ? 4 : 3; i < argc; i++) {
+                if (sendSource) {
+                    ifstream file(argv[i]);
+                    stringstream contents;
+                    contents << file.rdbuf();
+                    batch.push_back({false, contents.str()});
+                } else {
+                    batch.push_back({true, absolutePath(argv[i])});
+                }
+            }
+
+            ParserClient client(socketPath);
+            vector<ParserResult> results = client.parse(batch);
+            int failures = 0;
+            for (size_t i = 0; i < results.size(); i++) {
+                ParseTree* tree = results[i].ok ? ParseTree::deserialize(results[i].text) : NULL;
+                if (tree != NULL) {
+                    cout << tree->tostring() << endl;
+                    ParseTree::destroy(tree);
+                } else {
+                    cout << "Error Parsing! " << results[i].text << endl;
+                    failures++;
+                }
+            }
+            return failures == 0 ? 0 : 1;
+        }
+    } catch (exception& e) {
+        cout << e.what() << endl;
+        return 1;
+    }
+
+    cout << "Unknown mode " << mode << endl;
+    return 2;
+}
@@ -7,4 +7,76 @@ using namespace std;
  * @param value The token's value. Can be read using token.getValue()
  */
 Token::Token(string type, string value) : ParseTree(type, value) {
-}
\ No newline at end of file
+}
+/**
+ * Read a token stream with one token per line: the token type, a space, then the value.
+ * Blank lines are skipped.
+ * @param in The stream to read from
+ * @param table If given, tokens are shared through this table instead of allocated per line
+ * @return A linked list of tokens in the order they were read
+ */
+list<Token*> Token::read(istream& in, TokenTable* table) {
+    list<Token*> tokens;
+    string line;
+    while (getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+        size_t split = line.find(' ');
+        string type = line.substr(0, split);
+        string value = split == string::npos ? "" : line.substr(split + 1);
+        if (table != NULL) {
+            tokens.push_back(table->intern(type, value));
+        } else {
+            tokens.push_back(new Token(type, value));
+        }
+    }
+    return tokens;
+}
+
+/**
+ * Frees every token owned by the table
+ */
+TokenTable::~TokenTable() {
+    clear();
+}
+
+/**
+ * Get the shared token for a type and value, creating it on first use.
+ * Tokens are never modified by the parser, so one instance can appear in any number of token lists.
+ * @param type The type of token
+ * @param value The token's value
+ * @return The shared Token
+ */
+Token* TokenTable::intern(string type, string value) {
+    string key = type + '\0' + value;
+    auto found = tokens.find(key);
+    if (found != tokens.end()) {
+        return found->second;
+    }
+    Token* token = new Token(type, value);
+    tokens.emplace(key, token);
+    return token;
+}
+
+/**
+ * Frees every token owned by the table, leaving it empty.
+ * Token lists read through the table must not be used afterwards.
+ */
+void TokenTable::clear() {
+    for (auto& entry : tokens) {
+        delete entry.second;
+    }
+    tokens.clear();
+}
+
+/**
+ * Get the number of distinct tokens in the table
+ * @return The number of tokens
+ */
+size_t TokenTable::size() {
+    return tokens.size();
+}
@@ -2,12 +2,33 @@
 #define TOKEN_H
 
 #include <string>
+#include <list>
+#include <istream>
+#include <unordered_map>
 
 #include "ParseTree.h"
 
+class TokenTable;
+
 class Token : public ParseTree {
     public:
         Token(std::string type, std::string value);
+
+        static std::list<Token*> read(std::istream& in, TokenTable* table = NULL);
+};
+
+class TokenTable {
+    private:
+        std::unordered_map<std::string, Token*> tokens;
+
+    public:
+        ~TokenTable();
+
+        Token* intern(std::string type, std::string value);
+
+        void clear();
+
+        size_t size();
 };
 
-#endif /*TOKEN_H*/
\ No newline at end of file
+#endif /*TOKEN_H*/
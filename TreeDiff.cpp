@@ -0,0 +1,222 @@
+#include "TreeDiff.h"
+
+using namespace std;
+
+/**
+ * Check if two subtrees are identical by their structural hashes, without walking them
+ */
+static bool same(ParseTree* a, ParseTree* b) {
+    if (a == b) {
+        return true;
+    }
+    if (a == NULL || b == NULL) {
+        return false;
+    }
+    return a->getHash() == b->getHash() && a->getType() == b->getType();
+}
+
+/**
+ * Get the name of a subroutine node (its third child)
+ */
+static string subroutineName(ParseTree* tree) {
+    const list<ParseTree*>& children = tree->getChildren();
+    if (children.size() < 3) {
+        return "";
+    }
+    auto it = children.begin();
+    advance(it, 2);
+    return (*it)->getValue();
+}
+
+/**
+ * Get the key used to pair up changed children: subroutines by name, everything else by type
+ */
+static string key(ParseTree* tree) {
+    if (tree == NULL) {
+        return "";
+    }
+    if (tree->getType() == "subroutine") {
+        return "subroutine:" + subroutineName(tree);
+    }
+    return tree->getType();
+}
+
+/**
+ * Get the path segment for a child node: its key and its position, e.g. "subroutine:f[4]".
+ * The position keeps paths unique when a subroutine is moved or a name appears twice.
+ * @param index The child's position in its parent
+ */
+static string segment(ParseTree* tree, size_t index) {
+    return (tree == NULL ? string("null") : key(tree)) + "[" + to_string(index) + "]";
+}
+
+/**
+ * Check if a node's children should be aligned and diffed, rather than replacing the node as a whole
+ */
+static bool isContainer(string type) {
+    return type == "class" || type == "subroutine" || type == "subroutineBody" || type == "statements"
+        || type == "ifStatement" || type == "whileStatement";
+}
+
+/**
+ * Compute an edit script that turns one parse of a class into another.
+ * Children of classes, subroutines, bodies, statement lists and if/while statements are aligned,
+ * and identical subtrees are skipped by comparing their hashes, so unchanged regions cost O(1).
+ * Other nodes that differ are reported as a single REPLACE. A subroutine body from an outline
+ * parse is hashed from its tokens, so diffing an outline tree against a full parse loads each body.
+ * @param before The old ParseTree
+ * @param after The new ParseTree
+ * @return The edits in tree order; empty if the trees are identical
+ */
+vector<TreeEdit> TreeDiff::diff(ParseTree* before, ParseTree* after) {
+    TreeDiff differ;
+    ParseTree* root = after != NULL ? after : before;
+    differ.diffNode(before, after, root == NULL ? "" : root->getType());
+    return differ.edits;
+}
+
+/**
+ * Generate a string from an edit script, one edit per line:
+ * "+ path" for insertions, "- path" for deletions and "~ path" for replacements
+ * @param edits The edits from diff()
+ * @return A printable representation of the edit script
+ */
+string TreeDiff::tostring(vector<TreeEdit> edits) {
+    string output = "";
+    for (TreeEdit& edit : edits) {
+        if (edit.kind == TreeEdit::INSERT) {
+            output += "+ ";
+        } else if (edit.kind == TreeEdit::DELETE) {
+            output += "- ";
+        } else {
+            output += "~ ";
+        }
+        output += edit.path + "\n";
+    }
+    return output;
+}
+
+/**
+ * Diff two nodes found at the same path
+ */
+void TreeDiff::diffNode(ParseTree* before, ParseTree* after, string path) {
+    if (same(before, after)) {
+        return;
+    }
+    if (before == NULL) {
+        edits.push_back({TreeEdit::INSERT, path, before, after});
+        return;
+    }
+    if (after == NULL) {
+        edits.push_back({TreeEdit::DELETE, path, before, after});
+        return;
+    }
+
+    string type = after->getType();
+    if (before->getType() != type || !isContainer(type)) {
+        edits.push_back({TreeEdit::REPLACE, path, before, after});
+        return;
+    }
+    diffAligned(before, after, path);
+}
+
+/**
+ * Diff the children of two nodes of the same type. Common prefixes and suffixes are skipped,
+ * the rest is aligned with a longest common subsequence over the children's hashes, and each
+ * unaligned gap is handed to diffGap().
+ */
+void TreeDiff::diffAligned(ParseTree* before, ParseTree* after, string path) {
+    const list<ParseTree*>& beforeList = before->getChildren();
+    const list<ParseTree*>& afterList = after->getChildren();
+    vector<ParseTree*> a(beforeList.begin(), beforeList.end());
+    vector<ParseTree*> b(afterList.begin(), afterList.end());
+
+    size_t start = 0;
+    while (start < a.size() && start < b.size() && same(a[start], b[start])) {
+        start++;
+    }
+    size_t aEnd = a.size();
+    size_t bEnd = b.size();
+    while (aEnd > start && bEnd > start && same(a[aEnd - 1], b[bEnd - 1])) {
+        aEnd--;
+        bEnd--;
+    }
+
+    size_t n = aEnd - start;
+    size_t m = bEnd - start;
+    if (n == 0 || m == 0 || n * m > 4000000) {
+        // Nothing to align, or too large to align: treat the whole middle as one gap
+        diffGap(a, start, aEnd, b, start, bEnd, path);
+        return;
+    }
+
+    // lcs[i][j] is the length of the common subsequence of a[start+i..aEnd) and b[start+j..bEnd)
+    vector<vector<int>> lcs(n + 1, vector<int>(m + 1, 0));
+    for (size_t i = n; i > 0; i--) {
+        for (size_t j = m; j > 0; j--) {
+            if (same(a[start + i - 1], b[start + j - 1])) {
+                lcs[i - 1][j - 1] = lcs[i][j] + 1;
+            } else {
+                lcs[i - 1][j - 1] = max(lcs[i][j - 1], lcs[i - 1][j]);
+            }
+        }
+    }
+
+    size_t i = 0;
+    size_t j = 0;
+    size_t gapA = 0;
+    size_t gapB = 0;
+    while (i < n && j < m) {
+        if (same(a[start + i], b[start + j])) {
+            diffGap(a, start + gapA, start + i, b, start + gapB, start + j, path);
+            i++;
+            j++;
+            gapA = i;
+            gapB = j;
+        } else if (lcs[i + 1][j] >= lcs[i][j + 1]) {
+            i++;
+        } else {
+            j++;
+        }
+    }
+    diffGap(a, start + gapA, aEnd, b, start + gapB, bEnd, path);
+}
+
+/**
+ * Diff a run of children that did not align. Children with the same key (the same subroutine
+ * name, or the same statement type) are paired in order and diffed recursively; the rest are
+ * reported as deletions and insertions. Deleted paths use indices from the old tree, all other
+ * paths use indices from the new tree.
+ */
+void TreeDiff::diffGap(vector<ParseTree*>& before, size_t beforeStart, size_t beforeEnd,
+                       vector<ParseTree*>& after, size_t afterStart, size_t afterEnd, string path) {
+    vector<bool> paired(afterEnd - afterStart, false);
+    size_t next = afterStart;
+    for (size_t i = beforeStart; i < beforeEnd; i++) {
+        string k = key(before[i]);
+        size_t match = afterEnd;
+        for (size_t j = next; j < afterEnd; j++) {
+            if (key(after[j]) == k) {
+                match = j;
+                break;
+            }
+        }
+        if (match == afterEnd) {
+            edits.push_back({TreeEdit::DELETE, path + "/" + segment(before[i], i), before[i], NULL});
+            continue;
+        }
+        // Children skipped over to reach the match are insertions
+        for (size_t j = next; j < match; j++) {
+            edits.push_back({TreeEdit::INSERT, path + "/" + segment(after[j], j), NULL, after[j]});
+            paired[j - afterStart] = true;
+        }
+        diffNode(before[i], after[match], path + "/" + segment(after[match], match));
+        paired[match - afterStart] = true;
+        next = match + 1;
+    }
+    for (size_t j = afterStart; j < afterEnd; j++) {
+        if (!paired[j - afterStart]) {
+            edits.push_back({TreeEdit::INSERT, path + "/" + segment(after[j], j), NULL, after[j]});
+        }
+    }
+}
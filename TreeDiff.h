@@ -0,0 +1,37 @@
+#ifndef TREEDIFF_H
+#define TREEDIFF_H
+
+#include <string>
+#include <vector>
+
+#include "ParseTree.h"
+
+/**
+ * One step of an edit script. Paths name each node by type and child index, with subroutines also
+ * named, e.g. "class/subroutine:main[3]/subroutineBody[5]/statements[1]/letStatement[0]".
+ */
+struct TreeEdit {
+    enum Kind { INSERT, DELETE, REPLACE };
+
+    Kind kind;
+    std::string path;
+    ParseTree* before;
+    ParseTree* after;
+};
+
+class TreeDiff {
+    private:
+        std::vector<TreeEdit> edits;
+
+        void diffNode(ParseTree* before, ParseTree* after, std::string path);
+        void diffAligned(ParseTree* before, ParseTree* after, std::string path);
+        void diffGap(std::vector<ParseTree*>& before, size_t beforeStart, size_t beforeEnd,
+                     std::vector<ParseTree*>& after, size_t afterStart, size_t afterEnd, std::string path);
+
+    public:
+        static std::vector<TreeEdit> diff(ParseTree* before, ParseTree* after);
+
+        static std::string tostring(std::vector<TreeEdit> edits);
+};
+
+#endif /*TREEDIFF_H*/